@@ -0,0 +1,585 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ * Load generator for location-ui. Issues a weighted mix of dialog calls
+ * at a fixed rate against whatever bus DBUS_SYSTEM_BUS_ADDRESS points
+ * to, follows every dialog until its response signal and prints latency
+ * percentiles as CSV. See run-bench.sh for the private bus setup.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dbus/dbus.h>
+#include <dbus/dbus-glib-lowlevel.h>
+#include <glib.h>
+
+/* macros */
+#define nelem(x) (sizeof (x) / sizeof *(x))
+
+#define LUI_DBUS_NAME    "com.nokia.Location.UI"
+#define LUI_DBUS_DIALOG  LUI_DBUS_NAME".Dialog"
+#define LUI_DBUS_PATH    "/com/nokia/location/ui"
+
+#define BENCH_CALL_TIMEOUT_MS 10000
+#define BENCH_DRAIN_MS 10000
+
+/* enums */
+typedef enum {
+	OP_DISPLAY,
+	OP_CLOSE,
+	OP_VERIFICATION,
+	OP_TIMEOUT,
+	OP_COUNT,
+} bench_op;
+
+typedef enum {
+	METRIC_REPLY_DISPLAY,
+	METRIC_REPLY_CLOSE,
+	METRIC_REPLY_VERIFICATION,
+	METRIC_REPLY_TIMEOUT,
+	METRIC_PRESENT,
+	METRIC_COMPLETE,
+	METRIC_COUNT,
+} bench_metric;
+
+/* One dialog followed from its first call until it is closed again */
+typedef struct bench_flow {
+	char *path;
+	gint64 started;		/* first call of the flow was sent */
+	gint64 displayed;	/* display call was sent */
+} bench_flow;
+
+/* A call waiting for its reply */
+typedef struct bench_call {
+	struct bench_t *bench;
+	bench_op op;
+	bench_metric metric;
+	gint64 sent;
+	bench_flow *flow;
+} bench_call;
+
+typedef struct bench_samples {
+	GArray *ms;
+	guint errors;
+} bench_samples;
+
+typedef struct bench_t {
+	GMainLoop *loop;
+	DBusConnection *dbus;
+	GHashTable *flows;	/* dialog path -> bench_flow */
+	bench_samples metrics[METRIC_COUNT];
+	guint weights[OP_COUNT];
+	guint weight_total;
+	gint64 started;
+	gint64 stopped;
+	guint64 issued;
+	guint calls;
+	guint skipped;
+	guint tick_id;
+} bench_t;
+
+/* variables */
+static const char *op_names[OP_COUNT] = {
+	"display", "close", "location_verification", "location_timeout",
+};
+
+static const char *metric_names[METRIC_COUNT] = {
+	"reply_display", "reply_close", "reply_location_verification",
+	"reply_location_timeout", "present", "complete",
+};
+
+static const char *static_paths[] = {
+	LUI_DBUS_PATH"/bt_disconnected",
+	LUI_DBUS_PATH"/enable_gps",
+	LUI_DBUS_PATH"/enable_network",
+	LUI_DBUS_PATH"/enable_agnss",
+};
+
+static gint rate = 50;
+static gint duration = 10;
+static gint think;
+static gint max_inflight = 32;
+static gint wait_name = 10;
+static gchar *mix = "display=1,close=1,location_verification=4,"
+		    "location_timeout=2";
+static gchar *output;
+
+static GOptionEntry option_entries[] = {
+	{"rate", 'r', 0, G_OPTION_ARG_INT, &rate,
+	 "Operations started per second", "N"},
+	{"duration", 'd', 0, G_OPTION_ARG_INT, &duration,
+	 "Length of the run", "SECONDS"},
+	{"mix", 'm', 0, G_OPTION_ARG_STRING, &mix,
+	 "Relative weight of each operation", "OP=W,..."},
+	{"think", 't', 0, G_OPTION_ARG_INT, &think,
+	 "Answer delay location-ui was started with", "MS"},
+	{"max-inflight", 'j', 0, G_OPTION_ARG_INT, &max_inflight,
+	 "Dialogs open at the same time before operations are skipped", "N"},
+	{"wait", 'w', 0, G_OPTION_ARG_INT, &wait_name,
+	 "How long to wait for location-ui to claim its name", "SECONDS"},
+	{"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+	 "Write the CSV report here instead of stdout", "FILE"},
+	{NULL}
+};
+
+/* function declarations */
+static gboolean parse_mix(bench_t *, const char *, GError **);
+static void bench_record(bench_t *, bench_metric, gint64);
+static void bench_send(bench_t *, bench_op, bench_metric, const char *,
+		       const char *, DBusMessage *, bench_flow *);
+static void bench_display(bench_t *, bench_flow *);
+static void bench_close(bench_t *, const char *, bench_flow *);
+static void bench_issue(bench_t *, bench_op);
+static void on_reply(DBusPendingCall *, void *);
+static DBusHandlerResult on_signal(DBusConnection *, DBusMessage *, void *);
+static gboolean on_tick(bench_t *);
+static gboolean on_drain_timeout(bench_t *);
+static void bench_stop(bench_t *);
+static gint compare_double(gconstpointer, gconstpointer);
+static double percentile(GArray *, double);
+static void bench_report(bench_t *, FILE *);
+static gboolean bench_check_errors(bench_t *);
+
+/* function implementations */
+gboolean parse_mix(bench_t * bench, const char *spec, GError ** error)
+{
+	gchar **items, **kv;
+	int i, op;
+
+	memset(bench->weights, 0, sizeof(bench->weights));
+	bench->weight_total = 0;
+
+	items = g_strsplit(spec, ",", -1);
+	for (i = 0; items[i]; i++) {
+		kv = g_strsplit(items[i], "=", 2);
+
+		for (op = 0; op < OP_COUNT; op++)
+			if (!g_strcmp0(kv[0], op_names[op]))
+				break;
+
+		if (op == OP_COUNT || !kv[1]) {
+			g_set_error(error, G_OPTION_ERROR,
+				    G_OPTION_ERROR_BAD_VALUE,
+				    "Bad mix entry '%s'", items[i]);
+			g_strfreev(kv);
+			g_strfreev(items);
+			return FALSE;
+		}
+
+		bench->weights[op] = atoi(kv[1]);
+		bench->weight_total += bench->weights[op];
+		g_strfreev(kv);
+	}
+	g_strfreev(items);
+
+	if (!bench->weight_total) {
+		g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+			    "Mix has no operations");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void bench_record(bench_t * bench, bench_metric metric, gint64 us)
+{
+	double ms = us / 1000.0;
+
+	g_array_append_val(bench->metrics[metric].ms, ms);
+}
+
+void bench_send(bench_t * bench, bench_op op, bench_metric metric,
+		const char *path, const char *member, DBusMessage * msg,
+		bench_flow * flow)
+{
+	DBusPendingCall *pending;
+	bench_call *call;
+
+	if (!msg)
+		msg = dbus_message_new_method_call(LUI_DBUS_NAME, path,
+						   LUI_DBUS_DIALOG, member);
+
+	call = g_slice_new(bench_call);
+	call->bench = bench;
+	call->op = op;
+	call->metric = metric;
+	call->flow = flow;
+	call->sent = g_get_monotonic_time();
+
+	if (!dbus_connection_send_with_reply(bench->dbus, msg, &pending,
+					     BENCH_CALL_TIMEOUT_MS)
+	    || !pending) {
+		g_critical("%s: out of memory", G_STRFUNC);
+		exit(1);
+	}
+	dbus_message_unref(msg);
+
+	bench->calls++;
+	dbus_pending_call_set_notify(pending, on_reply, call, NULL);
+}
+
+void bench_display(bench_t * bench, bench_flow * flow)
+{
+	flow->displayed = g_get_monotonic_time();
+	bench_send(bench, OP_DISPLAY, METRIC_REPLY_DISPLAY, flow->path,
+		   "display", NULL, flow);
+}
+
+void bench_close(bench_t * bench, const char *path, bench_flow * flow)
+{
+	bench_send(bench, OP_CLOSE, METRIC_REPLY_CLOSE, path, "close", NULL,
+		   flow);
+}
+
+void bench_issue(bench_t * bench, bench_op op)
+{
+	const char *path, *member, *strv[2];
+	const char **argv = strv;
+	bench_flow *flow;
+	DBusMessage *msg;
+	gint32 accepted;
+
+	switch (op) {
+	case OP_DISPLAY:
+	case OP_CLOSE:
+		path = static_paths[g_random_int_range(0, nelem(static_paths))];
+		if (g_hash_table_lookup(bench->flows, path)) {
+			bench->skipped++;
+			return;
+		}
+
+		if (op == OP_CLOSE) {
+			bench_close(bench, path, NULL);
+			return;
+		}
+
+		flow = g_slice_new(bench_flow);
+		flow->path = g_strdup(path);
+		flow->started = g_get_monotonic_time();
+		g_hash_table_insert(bench->flows, flow->path, flow);
+		bench_display(bench, flow);
+		return;
+
+	case OP_VERIFICATION:
+	case OP_TIMEOUT:
+		member = op_names[op];
+		msg = dbus_message_new_method_call(LUI_DBUS_NAME,
+						   LUI_DBUS_PATH, LUI_DBUS_NAME,
+						   member);
+
+		/* Distinct requestors so nothing is coalesced */
+		strv[0] = g_strdup_printf("bench-%" G_GUINT64_FORMAT,
+					  bench->issued);
+		strv[1] = "lui-bench";
+
+		/* Every default the server takes, -1, 0 and 1 in turn */
+		accepted = (gint32) (bench->issued % 3) - 1;
+		dbus_message_append_args(msg, DBUS_TYPE_INT32, &accepted,
+					 DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+					 &argv, 2, DBUS_TYPE_INVALID);
+		g_free((gchar *) strv[0]);
+
+		bench_send(bench, op, op == OP_VERIFICATION ?
+			   METRIC_REPLY_VERIFICATION :
+			   METRIC_REPLY_TIMEOUT, LUI_DBUS_PATH, member, msg,
+			   NULL);
+		return;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+void on_reply(DBusPendingCall * pending, void *data)
+{
+	bench_call *call = data;
+	bench_t *bench = call->bench;
+	bench_flow *flow = call->flow;
+	DBusMessage *reply;
+	const char *path;
+	gint64 now = g_get_monotonic_time();
+
+	reply = dbus_pending_call_steal_reply(pending);
+	bench->calls--;
+
+	if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+		g_debug("%s: %s failed: %s", G_STRFUNC, op_names[call->op],
+			dbus_message_get_error_name(reply));
+		bench->metrics[call->metric].errors++;
+
+		/* The dialog will not come up, stop following it */
+		if (flow && call->op == OP_DISPLAY) {
+			bench_close(bench, flow->path, NULL);
+			g_hash_table_remove(bench->flows, flow->path);
+		}
+		goto out;
+	}
+
+	bench_record(bench, call->metric, now - call->sent);
+
+	if (call->op == OP_VERIFICATION || call->op == OP_TIMEOUT) {
+		if (!dbus_message_get_args(reply, NULL, DBUS_TYPE_OBJECT_PATH,
+					   &path, DBUS_TYPE_INVALID)) {
+			bench->metrics[call->metric].errors++;
+			goto out;
+		}
+
+		flow = g_slice_new(bench_flow);
+		flow->path = g_strdup(path);
+		flow->started = call->sent;
+		g_hash_table_insert(bench->flows, flow->path, flow);
+		bench_display(bench, flow);
+	}
+
+out:
+	dbus_message_unref(reply);
+	dbus_pending_call_unref(pending);
+	g_slice_free(bench_call, call);
+
+	if (bench->stopped && !bench->calls &&
+	    !g_hash_table_size(bench->flows))
+		g_main_loop_quit(bench->loop);
+}
+
+DBusHandlerResult on_signal(DBusConnection * conn, DBusMessage * msg,
+			    void *data)
+{
+	bench_t *bench = data;
+	bench_flow *flow;
+	gint64 now = g_get_monotonic_time();
+
+	if (!dbus_message_is_signal(msg, LUI_DBUS_DIALOG, "response"))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	flow = g_hash_table_lookup(bench->flows, dbus_message_get_path(msg));
+	if (!flow)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	/* The answer comes think ms after the dialog was presented */
+	bench_record(bench, METRIC_PRESENT,
+		     MAX(now - flow->displayed - think * 1000, 0));
+	bench_record(bench, METRIC_COMPLETE, now - flow->started);
+
+	bench_close(bench, flow->path, NULL);
+	g_hash_table_remove(bench->flows, flow->path);
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+gboolean on_tick(bench_t * bench)
+{
+	gint64 now = g_get_monotonic_time();
+	guint64 due;
+	guint pick, op;
+
+	if (now - bench->started >= (gint64) duration * G_USEC_PER_SEC) {
+		bench_stop(bench);
+		return FALSE;
+	}
+
+	/* Catch up on whatever the timer lagged behind */
+	due = (now - bench->started) * rate / G_USEC_PER_SEC;
+	for (; bench->issued < due; bench->issued++) {
+		if (g_hash_table_size(bench->flows) + bench->calls >=
+		    (guint) max_inflight) {
+			bench->skipped++;
+			continue;
+		}
+
+		pick = g_random_int_range(0, bench->weight_total);
+		for (op = 0; pick >= bench->weights[op]; op++)
+			pick -= bench->weights[op];
+		bench_issue(bench, op);
+	}
+
+	return TRUE;
+}
+
+gboolean on_drain_timeout(bench_t * bench)
+{
+	g_warning("%u calls and %u dialogs still open, giving up",
+		  bench->calls, g_hash_table_size(bench->flows));
+	g_main_loop_quit(bench->loop);
+	return FALSE;
+}
+
+void bench_stop(bench_t * bench)
+{
+	bench->stopped = g_get_monotonic_time();
+	bench->tick_id = 0;
+
+	if (!bench->calls && !g_hash_table_size(bench->flows))
+		g_main_loop_quit(bench->loop);
+	else
+		g_timeout_add(BENCH_DRAIN_MS, (GSourceFunc) on_drain_timeout,
+			      bench);
+}
+
+gint compare_double(gconstpointer a, gconstpointer b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest rank on a sorted array */
+double percentile(GArray * ms, double p)
+{
+	guint rank;
+
+	if (!ms->len)
+		return 0;
+
+	rank = (guint) (p / 100.0 * ms->len + 0.5);
+	rank = CLAMP(rank, 1, ms->len);
+	return g_array_index(ms, double, rank - 1);
+}
+
+void bench_report(bench_t * bench, FILE * out)
+{
+	bench_samples *s;
+	double secs;
+	int i;
+
+	secs = (bench->stopped - bench->started) / (double)G_USEC_PER_SEC;
+
+	fprintf(out, "metric,count,errors,p50_ms,p95_ms,p99_ms,max_ms,"
+		"per_second\n");
+	for (i = 0; i < METRIC_COUNT; i++) {
+		s = &bench->metrics[i];
+		g_array_sort(s->ms, compare_double);
+		fprintf(out, "%s,%u,%u,%.3f,%.3f,%.3f,%.3f,%.1f\n",
+			metric_names[i], s->ms->len, s->errors,
+			percentile(s->ms, 50), percentile(s->ms, 95),
+			percentile(s->ms, 99), percentile(s->ms, 100),
+			secs > 0 ? s->ms->len / secs : 0);
+	}
+	fprintf(out, "skipped,%u,0,0,0,0,0,%.1f\n", bench->skipped,
+		secs > 0 ? bench->skipped / secs : 0);
+}
+
+/*
+ * A display can lose the race for a static dialog, so its errors only
+ * warn. A rejected request means the load never reached the scheduler.
+ */
+gboolean bench_check_errors(bench_t * bench)
+{
+	gboolean ok = TRUE;
+	guint errors;
+	int i;
+
+	for (i = 0; i < METRIC_COUNT; i++) {
+		errors = bench->metrics[i].errors;
+		if (!errors)
+			continue;
+
+		g_printerr("warning: %u %s calls failed\n", errors,
+			   metric_names[i]);
+		if (i == METRIC_REPLY_VERIFICATION ||
+		    i == METRIC_REPLY_TIMEOUT)
+			ok = FALSE;
+	}
+
+	return ok;
+}
+
+static void bench_flow_free(gpointer data)
+{
+	bench_flow *flow = data;
+
+	g_free(flow->path);
+	g_slice_free(bench_flow, flow);
+}
+
+int main(int argc, char **argv)
+{
+	bench_t bench;
+	GOptionContext *context;
+	GError *error = NULL;
+	DBusError err;
+	FILE *out = stdout;
+	gint64 deadline;
+	int i;
+
+	context = g_option_context_new("- drive location-ui and report "
+				       "latencies");
+	g_option_context_add_main_entries(context, option_entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)
+	    || !parse_mix(&bench, mix, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	if (rate <= 0 || duration <= 0 || max_inflight <= 0) {
+		g_printerr("rate, duration and max-inflight must be positive\n");
+		return 1;
+	}
+
+	dbus_error_init(&err);
+	bench.dbus = dbus_bus_get(DBUS_BUS_SYSTEM, &err);
+	if (!bench.dbus) {
+		g_printerr("Failed to connect: %s\n", err.message);
+		dbus_error_free(&err);
+		return 1;
+	}
+
+	deadline = g_get_monotonic_time() + wait_name * G_USEC_PER_SEC;
+	while (!dbus_bus_name_has_owner(bench.dbus, LUI_DBUS_NAME, NULL)) {
+		if (g_get_monotonic_time() > deadline) {
+			g_printerr("%s did not show up\n", LUI_DBUS_NAME);
+			return 1;
+		}
+		g_usleep(20000);
+	}
+
+	dbus_bus_add_match(bench.dbus, "type='signal',interface='"
+			   LUI_DBUS_DIALOG"',member='response'", NULL);
+	dbus_connection_add_filter(bench.dbus, on_signal, &bench, NULL);
+	dbus_connection_setup_with_g_main(bench.dbus, NULL);
+
+	bench.loop = g_main_loop_new(NULL, FALSE);
+	bench.flows = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+					    bench_flow_free);
+	for (i = 0; i < METRIC_COUNT; i++) {
+		bench.metrics[i].ms = g_array_sized_new(FALSE, FALSE,
+							sizeof(double),
+							rate * duration);
+		bench.metrics[i].errors = 0;
+	}
+	bench.issued = 0;
+	bench.calls = 0;
+	bench.skipped = 0;
+	bench.stopped = 0;
+	bench.started = g_get_monotonic_time();
+	bench.tick_id = g_timeout_add(1, (GSourceFunc) on_tick, &bench);
+
+	g_main_loop_run(bench.loop);
+
+	if (output && !(out = fopen(output, "w"))) {
+		g_printerr("Cannot write %s\n", output);
+		return 1;
+	}
+	bench_report(&bench, out);
+	if (out != stdout)
+		fclose(out);
+
+	return bench_check_errors(&bench) ? 0 : 1;
+}
@@ -0,0 +1,603 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ * Microbenchmark of the dialog core. main.c is compiled in with the null
+ * renderer and without a bus connection, so scheduling, dispatch routing
+ * and the dialog lifecycle are timed on their own, with queues far deeper
+ * than the service allows. Prints ns/op and allocations/op per benchmark
+ * and queue depth as CSV, and fails when a result falls behind a stored
+ * baseline. Allocation counts do not depend on the machine, so "make
+ * check" compares only those. Requests are built with libdbus and go
+ * through the libdbus transport's message ops.
+ */
+#include <stdio.h>
+#include <time.h>
+#include <dbus/dbus.h>
+
+/* Deep enough for the largest queue, handles still fit in a guint */
+#define LUI_DIALOG_SLOTS (1 << 17)
+
+#define main location_ui_main
+#include "main.c"
+#undef main
+
+/* macros */
+#define BENCH_SENDER ":1.42"
+#define BENCH_SEED 1
+
+/* One dialog core without a bus, filled with depth dialogs */
+typedef struct bench_core {
+	location_ui_t ui;
+	DBusMessage **requests;	/* depth + 1 calls of distinct content */
+	char **paths;		/* the dialogs created by bench_core_fill */
+	guint depth;
+	DBusMessage *display;
+	DBusMessage *close;
+	GRand *rand;
+} bench_core;
+
+typedef struct bench_result {
+	const char *name;
+	guint depth;
+	double ns;
+	double allocs;		/* < 0 when not counted */
+} bench_result;
+
+typedef struct bench_case {
+	const char *name;
+	gboolean displayed;	/* queue the background dialogs */
+	gboolean scheduled;	/* and put the first one on screen */
+	void (*op)(bench_core *, guint);
+} bench_case;
+
+/* function declarations */
+static gint64 now_ns(void);
+static DBusMessage *bench_request_new(guint);
+static DBusMessage *bench_call_new(const char *, const char *);
+static void bench_drop_outbox(bench_core *);
+static const char *bench_reply_path(bench_core *);
+static const char *bench_create(bench_core *, DBusMessage *);
+static void bench_core_init(bench_core *, guint);
+static void bench_core_fill(bench_core *, gboolean, gboolean);
+static void bench_core_free(bench_core *);
+static void op_route(bench_core *, guint);
+static void op_create_close(bench_core *, guint);
+static void op_push_remove(bench_core *, guint);
+static void op_select(bench_core *, guint);
+static void op_cycle(bench_core *, guint);
+static void bench_run(const bench_case *, guint, bench_result *);
+static GHashTable *baseline_load(const char *, GError **);
+static gboolean baseline_check(GHashTable *, const bench_result *);
+static GArray *parse_sizes(const char *, GError **);
+
+/* variables */
+static const bench_case cases[] = {
+	{"route", FALSE, FALSE, op_route},
+	{"create_close", FALSE, FALSE, op_create_close},
+	{"push_remove", TRUE, FALSE, op_push_remove},
+	{"select", TRUE, FALSE, op_select},
+	{"cycle", TRUE, TRUE, op_cycle},
+};
+
+static gchar *sizes = "10,100,1000,10000,100000";
+static gint iterations = 100000;
+static gchar *baseline;
+static gint tolerance = 25;
+static gboolean allocs_only;
+static gchar *output;
+
+static GOptionEntry bench_options[] = {
+	{"sizes", 's', 0, G_OPTION_ARG_STRING, &sizes,
+	 "Queue depths to measure at", "N,..."},
+	{"iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+	 "Timed operations per benchmark and depth", "N"},
+	{"baseline", 'b', 0, G_OPTION_ARG_FILENAME, &baseline,
+	 "Fail when slower or allocating more than this earlier report",
+	 "FILE"},
+	{"tolerance", 't', 0, G_OPTION_ARG_INT, &tolerance,
+	 "Slowdown against the baseline that still passes", "PERCENT"},
+	{"allocs-only", 'a', 0, G_OPTION_ARG_NONE, &allocs_only,
+	 "Only compare allocation counts with the baseline", NULL},
+	{"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+	 "Write the CSV report here instead of stdout", "FILE"},
+	{NULL}
+};
+
+/*
+ * Every allocation goes through malloc once GSlice is told to use it, so
+ * wrapping the glibc entry points counts them all, libdbus included.
+ */
+#ifdef __GLIBC__
+#define BENCH_COUNT_ALLOCS
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+static guint64 allocs;
+
+void *malloc(size_t size)
+{
+	allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	allocs++;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void * ptr, size_t size)
+{
+	allocs++;
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+/* function implementations */
+gint64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (gint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* A location_verification call whose content no other index shares */
+DBusMessage *bench_request_new(guint index)
+{
+	DBusMessage *msg;
+	DBusMessageIter iter, sub;
+	dbus_int32_t accepted = 0;
+	char requestor[32];
+	const char *strings[] = { requestor, "bench-client" };
+	int i;
+
+	g_snprintf(requestor, sizeof(requestor), "supl%u.example.org", index);
+
+	msg = bench_call_new(LUI_DBUS_PATH, "location_verification");
+	dbus_message_iter_init_append(msg, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_INT32, &accepted);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					 DBUS_TYPE_STRING_AS_STRING, &sub);
+	for (i = 0; i < nelem(strings); i++)
+		dbus_message_iter_append_basic(&sub, DBUS_TYPE_STRING,
+					       &strings[i]);
+	dbus_message_iter_close_container(&iter, &sub);
+	return msg;
+}
+
+/* Looks like it came off the bus, so replies can be made for it */
+DBusMessage *bench_call_new(const char * path, const char * member)
+{
+	static dbus_uint32_t serial;
+	DBusMessage *msg;
+
+	msg = dbus_message_new_method_call(LUI_DBUS_NAME, path,
+					   LUI_DBUS_DIALOG, member);
+	dbus_message_set_sender(msg, BENCH_SENDER);
+	dbus_message_set_serial(msg, ++serial);
+	return msg;
+}
+
+/* What the idle flush would have handed to libdbus */
+void bench_drop_outbox(bench_core * core)
+{
+	lui_outbox *outbox = &core->ui.outbox;
+	guint i;
+
+	for (i = 0; i < outbox->pending->len; i++)
+		dbus_message_unref(g_ptr_array_index(outbox->pending, i));
+	g_ptr_array_set_size(outbox->pending, 0);
+}
+
+/* Object path handed out by the request that was just dispatched */
+const char *bench_reply_path(bench_core * core)
+{
+	lui_outbox *outbox = &core->ui.outbox;
+	DBusMessage *reply;
+	const char *path = NULL;
+
+	g_assert(outbox->pending->len);
+	reply = g_ptr_array_index(outbox->pending, outbox->pending->len - 1);
+	if (!dbus_message_get_args(reply, NULL, DBUS_TYPE_OBJECT_PATH, &path,
+				   DBUS_TYPE_INVALID))
+		g_error("Request failed: %s",
+			dbus_message_get_error_name(reply));
+	return path;
+}
+
+/* Dispatch a request, returns the new dialog's path */
+const char *bench_create(bench_core * core, DBusMessage * msg)
+{
+	on_object_request((lui_msg *) msg, &core->ui);
+	return bench_reply_path(core);
+}
+
+/* Set up like main() does, minus the bus, the UI thread and the snapshot */
+void bench_core_init(bench_core * core, guint depth)
+{
+	location_ui_t *ui = &core->ui;
+	dbus_int32_t arg = 0;
+	guint i;
+
+	memset(core, 0, sizeof(*core));
+
+	/* The null renderer needs no init and there is nothing to prewarm */
+	ui->renderer = &lui_renderer_null;
+	ui->ui_ready = TRUE;
+	ui->answered = TRUE;
+	lui_pqueue_init(&ui->queue, compare_dialog_priority);
+	lui_linger_init(&ui->linger, 0, 0);
+	lui_decisions_open(&ui->decisions, 0);
+	memset(&ui->snapshot, 0, sizeof(ui->snapshot));
+
+	for (i = 0; i < nelem(funcmap); i++)
+		funcmap[i].pool_link.data = NULL;
+	g_queue_init(&ui->widget_pool);
+	g_queue_init(&ui->waiters);
+
+	lui_transport_current = &lui_transport_libdbus;
+	lui_outbox_init(&ui->outbox, NULL);
+	dispatch_init(ui);
+	dialog_slab_init(&ui->slab);
+	for (i = 0; i < nelem(funcmap); i++)
+		dispatch_add_dialog(ui, &funcmap[i]);
+
+	/* Identical requests would share a dialog instead of adding one */
+	core->depth = depth;
+	core->requests = g_new(DBusMessage *, depth + 1);
+	for (i = 0; i <= depth; i++)
+		core->requests[i] = bench_request_new(i);
+	core->paths = g_new0(char *, depth);
+	core->display = bench_call_new(LUI_DBUS_PATH, "display");
+	dbus_message_append_args(core->display, DBUS_TYPE_INT32, &arg,
+				 DBUS_TYPE_INVALID);
+	core->close = bench_call_new(LUI_DBUS_PATH, "close");
+	core->rand = g_rand_new_with_seed(BENCH_SEED);
+}
+
+/* Create the background dialogs, queued and shown if asked for */
+void bench_core_fill(bench_core * core, gboolean displayed,
+		     gboolean scheduled)
+{
+	location_ui_t *ui = &core->ui;
+	location_ui_dialog *dialog;
+	guint i;
+
+	for (i = 0; i < core->depth; i++) {
+		core->paths[i] = g_strdup(bench_create(core,
+						       core->requests[i]));
+		bench_drop_outbox(core);
+		if (!displayed)
+			continue;
+
+		/* Spread over a few levels so the heap has work to do */
+		dialog = dispatch_lookup_dialog(ui, core->paths[i]);
+		dialog_display(ui, dialog, 0,
+			       g_rand_int_range(core->rand, 0, 4), 0);
+	}
+
+	if (scheduled)
+		schedule_new_dialog(ui);
+}
+
+void bench_core_free(bench_core * core)
+{
+	location_ui_t *ui = &core->ui;
+	guint i;
+
+	for (i = 0; i < LUI_DIALOG_SLOTS; i++)
+		if (ui->slab.slots[i].dialog.id)
+			dialog_close(ui, &ui->slab.slots[i].dialog);
+	for (i = 0; i < nelem(funcmap); i++)
+		dialog_close(ui, &funcmap[i]);
+	widget_pool_trim(ui, 0);
+	bench_drop_outbox(core);
+
+	if (ui->outbox.idle_id)
+		lui_loop_remove(ui->outbox.idle_id);
+	if (ui->inactivity_timeout_id)
+		lui_loop_remove(ui->inactivity_timeout_id);
+	if (ui->aging_id)
+		lui_loop_remove(ui->aging_id);
+	if (ui->expiry_id)
+		lui_loop_remove(ui->expiry_id);
+	if (ui->prewarm_id)
+		lui_loop_remove(ui->prewarm_id);
+
+	g_ptr_array_free(ui->outbox.pending, TRUE);
+	lui_pqueue_clear(&ui->queue);
+	g_free(ui->slab.slots);
+	g_hash_table_destroy(ui->paths);
+	g_hash_table_destroy(ui->dialog_methods);
+	g_hash_table_destroy(ui->root_methods);
+	g_hash_table_destroy(ui->client_methods);
+	g_hash_table_destroy(ui->coalesce);
+	g_ptr_array_foreach(ui->stats.groups, (GFunc) g_free, NULL);
+	g_ptr_array_free(ui->stats.groups, TRUE);
+
+	for (i = 0; i <= core->depth; i++)
+		dbus_message_unref(core->requests[i]);
+	g_free(core->requests);
+	for (i = 0; i < core->depth; i++)
+		g_free(core->paths[i]);
+	g_free(core->paths);
+	dbus_message_unref(core->display);
+	dbus_message_unref(core->close);
+	g_rand_free(core->rand);
+}
+
+/* find_dbus_cb's lookups for a call on one of depth dialogs */
+void op_route(bench_core * core, guint i)
+{
+	location_ui_dialog *dialog;
+
+	if (!dispatch_lookup_member(core->ui.dialog_methods,
+				    (lui_msg *) core->close))
+		g_error("close is not routed");
+
+	dialog = dispatch_lookup_dialog(&core->ui,
+					core->paths[i % core->depth]);
+	g_assert(dialog != NULL);
+}
+
+/* A request and its close through on_object_request, depth others open */
+void op_create_close(bench_core * core, guint i)
+{
+	dbus_message_set_path(core->close,
+			      bench_create(core, core->requests[core->depth]));
+	bench_drop_outbox(core);
+	on_object_request((lui_msg *) core->close, &core->ui);
+	bench_drop_outbox(core);
+}
+
+/* Queue one more dialog behind depth others and take it out again */
+void op_push_remove(bench_core * core, guint i)
+{
+	location_ui_dialog *dialog = &funcmap[i % nelem(funcmap)];
+
+	dialog_display(&core->ui, dialog, 0, i % 4, 0);
+	dialog_close(&core->ui, dialog);
+}
+
+/* schedule_new_dialog's pick and dequeue, then back to the end */
+void op_select(bench_core * core, guint i)
+{
+	location_ui_dialog *dialog = find_next_dialog(&core->ui);
+
+	lui_pqueue_remove(&core->ui.queue, &dialog->qnode);
+	dialog->state = STATE_IDLE;
+	dialog->dialog_active = 0;
+	dialog_display(&core->ui, dialog, 0, dialog->priority, 0);
+}
+
+/*
+ * A whole dialog lifetime at a steady depth: the one on screen is
+ * answered, which schedules the next, its caller closes it and makes the
+ * same request again, which is displayed behind the others.
+ */
+void op_cycle(bench_core * core, guint i)
+{
+	location_ui_dialog *current = core->ui.current_dialog;
+	DBusMessage *request;
+
+	g_assert(current != NULL);
+	request = dbus_message_ref((DBusMessage *) current->req.msg);
+	on_dialog_response(current, 0, &core->ui);
+	dbus_message_set_path(core->close, current->path);
+	on_object_request((lui_msg *) core->close, &core->ui);
+	bench_drop_outbox(core);
+
+	dbus_message_set_path(core->display, bench_create(core, request));
+	dbus_message_unref(request);
+	bench_drop_outbox(core);
+	on_object_request((lui_msg *) core->display, &core->ui);
+	bench_drop_outbox(core);
+}
+
+void bench_run(const bench_case * bc, guint depth, bench_result * result)
+{
+	bench_core core;
+	gint64 start;
+	guint i, warmup = MAX(iterations / 10, 1);
+#ifdef BENCH_COUNT_ALLOCS
+	guint64 counted;
+#endif
+
+	bench_core_init(&core, depth);
+	bench_core_fill(&core, bc->displayed, bc->scheduled);
+
+	for (i = 0; i < warmup; i++)
+		bc->op(&core, i);
+
+#ifdef BENCH_COUNT_ALLOCS
+	counted = allocs;
+#endif
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+		bc->op(&core, warmup + i);
+	result->ns = (double)(now_ns() - start) / iterations;
+#ifdef BENCH_COUNT_ALLOCS
+	result->allocs = (double)(allocs - counted) / iterations;
+#else
+	result->allocs = -1;
+#endif
+	result->name = bc->name;
+	result->depth = depth;
+
+	bench_core_free(&core);
+}
+
+/*
+ * benchmark,dialogs,ns_per_op,allocs_per_op lines, keyed "name/depth".
+ * An empty field is not compared.
+ */
+GHashTable *baseline_load(const char * path, GError ** error)
+{
+	GHashTable *table;
+	gchar *contents, **lines, **f;
+	bench_result *r;
+	int i;
+
+	if (!g_file_get_contents(path, &contents, NULL, error))
+		return NULL;
+
+	table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+				      g_free);
+	lines = g_strsplit(contents, "\n", -1);
+	for (i = 0; lines[i]; i++) {
+		f = g_strsplit(lines[i], ",", -1);
+		if (g_strv_length(f) == 4 && g_ascii_isdigit(*f[1])) {
+			r = g_new0(bench_result, 1);
+			r->ns = *f[2] ? g_ascii_strtod(f[2], NULL) : -1;
+			r->allocs = *f[3] ? g_ascii_strtod(f[3], NULL) : -1;
+			g_hash_table_insert(table,
+					    g_strdup_printf("%s/%s", f[0],
+							    f[1]), r);
+		}
+		g_strfreev(f);
+	}
+	g_strfreev(lines);
+	g_free(contents);
+
+	return table;
+}
+
+/* Results without a baseline entry pass, there is nothing to compare */
+gboolean baseline_check(GHashTable * table, const bench_result * result)
+{
+	gchar *key = g_strdup_printf("%s/%u", result->name, result->depth);
+	bench_result *base = g_hash_table_lookup(table, key);
+	gboolean ok = TRUE;
+
+	if (base && !allocs_only && base->ns >= 0 &&
+	    result->ns > base->ns * (100 + tolerance) / 100) {
+		g_printerr("%s: %.1f ns/op, baseline %.1f (+%.0f%%)\n", key,
+			   result->ns, base->ns,
+			   (result->ns / base->ns - 1) * 100);
+		ok = FALSE;
+	}
+
+	/* Counts are exact, any extra allocation is a change in the code */
+	if (base && base->allocs >= 0 && result->allocs >= 0 &&
+	    result->allocs > base->allocs + 0.5) {
+		g_printerr("%s: %.2f allocs/op, baseline %.2f\n", key,
+			   result->allocs, base->allocs);
+		ok = FALSE;
+	}
+
+	g_free(key);
+	return ok;
+}
+
+GArray *parse_sizes(const char * spec, GError ** error)
+{
+	GArray *depths = g_array_new(FALSE, FALSE, sizeof(guint));
+	gchar **items, *end;
+	guint64 depth;
+	int i;
+
+	items = g_strsplit(spec, ",", -1);
+	for (i = 0; items[i]; i++) {
+		depth = g_ascii_strtoull(items[i], &end, 10);
+		if (end == items[i] || *end || !depth ||
+		    depth > LUI_DIALOG_SLOTS - 2) {
+			g_set_error(error, G_OPTION_ERROR,
+				    G_OPTION_ERROR_BAD_VALUE,
+				    "Bad size '%s', 1 to %u", items[i],
+				    LUI_DIALOG_SLOTS - 2);
+			g_strfreev(items);
+			g_array_free(depths, TRUE);
+			return NULL;
+		}
+		g_array_append_vals(depths, &(guint) { depth }, 1);
+	}
+	g_strfreev(items);
+
+	return depths;
+}
+
+int main(int argc, char ** argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GHashTable *base = NULL;
+	GArray *depths;
+	bench_result result;
+	FILE *out = stdout;
+	gboolean ok = TRUE;
+	int c, d;
+
+	/* Before the first slice is cut, or its magazines hide allocations */
+	g_setenv("G_SLICE", "always-malloc", TRUE);
+
+	context = g_option_context_new("- time the dialog core in-process");
+	g_option_context_add_main_entries(context, bench_options, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)
+	    || !(depths = parse_sizes(sizes, &error))) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	if (iterations <= 0 || tolerance < 0) {
+		g_printerr("iterations must be positive, tolerance not "
+			   "negative\n");
+		return 1;
+	}
+
+	if (baseline && !(base = baseline_load(baseline, &error))) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+
+	if (output && !(out = fopen(output, "w"))) {
+		g_printerr("Cannot write %s\n", output);
+		return 1;
+	}
+
+	/* Timers the core arms go here and are never run */
+	lui_loop_set_context(g_main_context_new());
+	lui_renderer_null_script(0, 0, NULL);
+
+	fprintf(out, "benchmark,dialogs,ns_per_op,allocs_per_op\n");
+	for (c = 0; c < nelem(cases); c++) {
+		for (d = 0; d < depths->len; d++) {
+			bench_run(&cases[c], g_array_index(depths, guint, d),
+				  &result);
+			fprintf(out, "%s,%u,%.1f,%.2f\n", result.name,
+				result.depth, result.ns, result.allocs);
+			fflush(out);
+			if (base && !baseline_check(base, &result))
+				ok = FALSE;
+		}
+	}
+
+	if (out != stdout)
+		fclose(out);
+	if (base)
+		g_hash_table_destroy(base);
+	g_array_free(depths, TRUE);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#!/bin/sh
+#
+# Start a private dbus-daemon and X server, run location-ui on them and
+# drive it with lui-bench. Extra arguments go to lui-bench.
+#
+# usage: run-bench.sh LOCATION_UI LUI_BENCH [lui-bench options]
+#
+# THINK sets how long location-ui waits before answering each dialog.
+# RENDERER=null runs location-ui headless, without any X server.
+# TRANSPORT picks the bus backend, libdbus or gdbus; either must have
+# been built in, location-ui's configure time default is used if unset.
+
+set -e
+
+ui=$1
+bench=$2
+shift 2
+
+srcdir=$(dirname "$0")
+think=${THINK:-0}
+renderer=${RENDERER:-hildon}
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/lui-bench.XXXXXX")
+bus_pid=
+x_pid=
+ui_pid=
+answer=
+transport=${TRANSPORT:+--transport=$TRANSPORT}
+
+cleanup() {
+	for pid in $ui_pid $x_pid $bus_pid; do
+		kill "$pid" 2>/dev/null || :
+	done
+	rm -rf "$tmp"
+}
+trap cleanup EXIT INT TERM
+
+dbus-daemon --nofork --config-file="$srcdir/bench-bus.conf" \
+	--address="unix:dir=$tmp" --print-address=3 3>"$tmp/address" &
+bus_pid=$!
+while [ ! -s "$tmp/address" ]; do
+	kill -0 "$bus_pid" || exit 1
+	sleep 0.05
+done
+
+if [ "$renderer" = null ]; then
+	answer="--renderer=null --think=$think"
+	unset DISPLAY
+elif command -v Xvfb >/dev/null; then
+	display=":$((100 + $$ % 100))"
+	Xvfb "$display" -screen 0 800x480x16 -nolisten tcp 2>"$tmp/xvfb.log" &
+	x_pid=$!
+	DISPLAY=$display
+	export DISPLAY
+elif [ -z "$DISPLAY" ]; then
+	echo "run-bench.sh: Xvfb not found and DISPLAY is not set" >&2
+	exit 1
+fi
+answer=${answer:-"--auto-answer=$think"}
+
+DBUS_SYSTEM_BUS_ADDRESS=$(head -n1 "$tmp/address")
+XDG_RUNTIME_DIR=$tmp
+export DBUS_SYSTEM_BUS_ADDRESS XDG_RUNTIME_DIR
+
+# Keep location-ui alive across gaps in the load
+"$ui" --preinit $answer $transport --linger-min=60 --linger-max=60 \
+	2>"$tmp/location-ui.log" &
+ui_pid=$!
+
+"$bench" --think="$think" "$@"
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+
+#include "decisions.h"
+#include "mapfile.h"
+
+#define DECISIONS_FILE "location-ui.decisions"
+
+static void decisions_key(const char *requestor, const char *client,
+			  int accepted, guint8 * key)
+{
+	GChecksum *sum = g_checksum_new(G_CHECKSUM_SHA256);
+	guint8 digest[32];
+	gsize len = sizeof(digest);
+	gint32 flag = accepted;
+
+	/* The terminators keep ("ab", "c") apart from ("a", "bc") */
+	g_checksum_update(sum, (const guchar *)(requestor ? requestor : ""),
+			  strlen(requestor ? requestor : "") + 1);
+	g_checksum_update(sum, (const guchar *)(client ? client : ""),
+			  strlen(client ? client : "") + 1);
+	g_checksum_update(sum, (const guchar *)&flag, sizeof(flag));
+	g_checksum_get_digest(sum, digest, &len);
+	g_checksum_free(sum);
+
+	memcpy(key, digest, LUI_DECISION_KEY);
+}
+
+void lui_decisions_open(lui_decisions * d, guint ttl)
+{
+	memset(d, 0, sizeof(*d));
+	d->ttl = ttl;
+	if (!ttl)
+		return;
+
+	d->file = lui_mapfile_open(DECISIONS_FILE, sizeof(lui_decision_file));
+	if (!d->file)
+		return;
+
+	/* New, truncated or from another version, start over */
+	if (memcmp(d->file->magic, LUI_DECISION_MAGIC,
+		   sizeof(d->file->magic)) ||
+	    d->file->version != LUI_DECISION_VERSION ||
+	    d->file->entries != LUI_DECISION_ENTRIES) {
+		memset(d->file, 0, sizeof(*d->file));
+		memcpy(d->file->magic, LUI_DECISION_MAGIC,
+		       sizeof(d->file->magic));
+		d->file->version = LUI_DECISION_VERSION;
+		d->file->entries = LUI_DECISION_ENTRIES;
+	}
+}
+
+void lui_decisions_close(lui_decisions * d)
+{
+	lui_mapfile_close(d->file, sizeof(lui_decision_file));
+	d->file = NULL;
+}
+
+gboolean lui_decisions_lookup(lui_decisions * d, const char *requestor,
+			      const char *client, int accepted, int *code)
+{
+	guint8 key[LUI_DECISION_KEY];
+	gint64 now;
+	guint i;
+
+	if (!d->file)
+		return FALSE;
+
+	decisions_key(requestor, client, accepted, key);
+	now = g_get_real_time() / G_USEC_PER_SEC;
+
+	for (i = 0; i < LUI_DECISION_ENTRIES; i++) {
+		lui_decision *e = &d->file->entry[i];
+
+		if (e->expires > now && !memcmp(e->key, key, sizeof(key))) {
+			*code = e->code;
+			d->hits++;
+			return TRUE;
+		}
+	}
+
+	d->misses++;
+	return FALSE;
+}
+
+void lui_decisions_store(lui_decisions * d, const char *requestor,
+			 const char *client, int accepted, int code)
+{
+	guint8 key[LUI_DECISION_KEY];
+	lui_decision *e, *slot = NULL;
+	guint i;
+
+	if (!d->file)
+		return;
+
+	decisions_key(requestor, client, accepted, key);
+
+	/* Same request again, else whatever expires first */
+	for (i = 0; i < LUI_DECISION_ENTRIES; i++) {
+		e = &d->file->entry[i];
+		if (!memcmp(e->key, key, sizeof(key))) {
+			slot = e;
+			break;
+		}
+		if (!slot || e->expires < slot->expires)
+			slot = e;
+	}
+
+	memcpy(slot->key, key, sizeof(key));
+	slot->code = code;
+	slot->expires = g_get_real_time() / G_USEC_PER_SEC + d->ttl;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCATION_UI_DECISIONS_H__
+#define __LOCATION_UI_DECISIONS_H__
+
+#include <glib.h>
+
+/* Slots in the cache file, the one expiring first is reused */
+#define LUI_DECISION_ENTRIES 128
+
+#define LUI_DECISION_MAGIC   "LUIDECIS"
+#define LUI_DECISION_VERSION 1
+
+/* Requests are identified by a truncated SHA-256 of their content */
+#define LUI_DECISION_KEY 16
+
+typedef struct lui_decision {
+	guint8 key[LUI_DECISION_KEY];
+	gint64 expires;		/* wall clock, seconds, 0 for a free slot */
+	gint32 code;		/* response given by the user */
+	guint32 reserved;
+} lui_decision;
+
+typedef struct lui_decision_file {
+	char magic[8];
+	guint32 version;
+	guint32 entries;
+	lui_decision entry[LUI_DECISION_ENTRIES];
+} lui_decision_file;
+
+/*
+ * Remembers how the user answered privacy verification requests, so a
+ * repeated request can be answered without asking again. The file is
+ * mapped shared, entries outlive the process until their ttl runs out.
+ */
+typedef struct lui_decisions {
+	lui_decision_file *file;	/* NULL while disabled */
+	guint ttl;		/* seconds */
+	guint64 hits;
+	guint64 misses;
+} lui_decisions;
+
+void lui_decisions_open(lui_decisions *, guint ttl);
+void lui_decisions_close(lui_decisions *);
+gboolean lui_decisions_lookup(lui_decisions *, const char *requestor,
+			      const char *client, int accepted, int *code);
+void lui_decisions_store(lui_decisions *, const char *requestor,
+			 const char *client, int accepted, int code);
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "linger.h"
+
+#define LINGER_ALPHA 0.25
+#define LINGER_FILE "location-ui.linger"
+
+/* Shorter idle spells are calls of one burst, not gaps between requests */
+#define LINGER_BURST_MS 1000
+
+static gchar *linger_path(void)
+{
+	return g_build_filename(g_get_user_runtime_dir(), LINGER_FILE, NULL);
+}
+
+static void linger_load(lui_linger * l)
+{
+	gchar *path = linger_path(), *buf = NULL;
+	gdouble mean, dev;
+	guint samples;
+	gint64 idle_since, idle_us;
+	guint64 avoided;
+
+	if (g_file_get_contents(path, &buf, NULL, NULL) &&
+	    sscanf(buf, "%lf %lf %u %" G_GINT64_FORMAT " %" G_GUINT64_FORMAT
+		   " %" G_GINT64_FORMAT, &mean, &dev, &samples, &idle_since,
+		   &avoided, &idle_us) == 6) {
+		l->gap_mean = mean;
+		l->gap_dev = dev;
+		l->samples = samples;
+		l->idle_since = idle_since;
+		l->cold_starts_avoided = avoided;
+		l->idle_us = idle_us;
+	}
+
+	g_free(buf);
+	g_free(path);
+}
+
+void lui_linger_init(lui_linger * l, guint min_ms, guint max_ms)
+{
+	memset(l, 0, sizeof(*l));
+	l->min_ms = min_ms;
+	l->max_ms = MAX(min_ms, max_ms);
+	linger_load(l);
+}
+
+/* We just went idle, returns how long to stay around in milliseconds */
+guint lui_linger_idle(lui_linger * l)
+{
+	gdouble expected;
+	guint delay;
+
+	l->idle_since = g_get_real_time();
+	l->idle_local = TRUE;
+
+	/* Staying resident is what the system can least afford now */
+	if (lui_linger_under_pressure(l)) {
+		delay = l->min_ms;
+	} else if (!l->samples) {
+		delay = CLAMP(LUI_LINGER_DEFAULT_MS, l->min_ms, l->max_ms);
+	} else {
+		/* Cover most gaps, not just the average one */
+		expected = (l->gap_mean + 2 * l->gap_dev) / 1000;
+		if (expected > l->max_ms)
+			delay = l->min_ms;
+		else
+			delay = MAX((guint) expected, l->min_ms);
+	}
+
+	g_debug("%s: lingering %u ms (gap %.0f +- %.0f ms)", G_STRFUNC, delay,
+		l->gap_mean / 1000, l->gap_dev / 1000);
+	return delay;
+}
+
+/* A request arrived */
+void lui_linger_busy(lui_linger * l)
+{
+	gint64 gap;
+	gdouble diff;
+
+	if (!l->idle_since)
+		return;
+
+	gap = g_get_real_time() - l->idle_since;
+	l->idle_since = 0;
+	if (gap < 0)
+		return;
+
+	if (l->idle_local) {
+		l->idle_us += gap;
+		/* The fixed timer would have had us exit by now */
+		if (gap > LUI_LINGER_DEFAULT_MS * G_TIME_SPAN_MILLISECOND)
+			l->cold_starts_avoided++;
+	}
+	l->idle_local = FALSE;
+
+	/* Every message restarts the idle period, only learn real ones */
+	if (gap < LINGER_BURST_MS * G_TIME_SPAN_MILLISECOND)
+		return;
+
+	if (!l->samples++) {
+		l->gap_mean = gap;
+		l->gap_dev = gap / 2;
+	} else {
+		diff = ABS(gap - l->gap_mean);
+		l->gap_mean += LINGER_ALPHA * (gap - l->gap_mean);
+		l->gap_dev += LINGER_ALPHA * (diff - l->gap_dev);
+	}
+}
+
+/* The system is short on memory, exit as early as allowed for a while */
+void lui_linger_pressure(lui_linger * l)
+{
+	l->pressure_until = g_get_monotonic_time() +
+	    LUI_LINGER_PRESSURE_MS * G_TIME_SPAN_MILLISECOND;
+}
+
+/* Persist the history so the next activation starts from it */
+void lui_linger_save(lui_linger * l)
+{
+	gchar *path = linger_path(), *buf;
+	gint64 now = g_get_real_time();
+
+	if (l->idle_since && l->idle_local)
+		l->idle_us += now - l->idle_since;
+	l->idle_since = now;
+	l->idle_local = FALSE;
+
+	buf = g_strdup_printf("%f %f %u %" G_GINT64_FORMAT " %"
+			      G_GUINT64_FORMAT " %" G_GINT64_FORMAT "\n",
+			      l->gap_mean, l->gap_dev, l->samples,
+			      l->idle_since, l->cold_starts_avoided,
+			      l->idle_us);
+	if (!g_file_set_contents(path, buf, -1, NULL))
+		g_debug("%s: could not write %s", G_STRFUNC, path);
+
+	g_message("linger: %" G_GUINT64_FORMAT " cold starts avoided, %"
+		  G_GINT64_FORMAT " s idle", l->cold_starts_avoided,
+		  l->idle_us / G_USEC_PER_SEC);
+
+	g_free(buf);
+	g_free(path);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCATION_UI_LINGER_H__
+#define __LOCATION_UI_LINGER_H__
+
+#include <glib.h>
+
+/* Exit delay used while nothing is known about the request pattern */
+#define LUI_LINGER_DEFAULT_MS	15000
+
+/* How long the shortest delay applies after memory pressure */
+#define LUI_LINGER_PRESSURE_MS	60000
+
+/*
+ * Adaptive inactivity policy. The length of the idle gaps between
+ * requests is tracked as a moving average and deviation, and persisted
+ * across exits. If the next request is expected within max_ms we linger
+ * long enough to catch it, otherwise we exit after min_ms since staying
+ * resident would cost more idle memory than the cold start it saves.
+ */
+typedef struct lui_linger {
+	guint min_ms;
+	guint max_ms;
+
+	gdouble gap_mean;	/* idle gap average, microseconds */
+	gdouble gap_dev;	/* mean absolute deviation, microseconds */
+	guint samples;
+	gint64 idle_since;	/* wall clock, 0 while busy */
+	gboolean idle_local;	/* idle_since was set by this process */
+	gint64 pressure_until;	/* monotonic, stay no longer than min_ms */
+
+	/* statistics, cumulative over restarts */
+	guint64 cold_starts_avoided;
+	gint64 idle_us;
+} lui_linger;
+
+void lui_linger_init(lui_linger *, guint min_ms, guint max_ms);
+guint lui_linger_idle(lui_linger *);
+void lui_linger_busy(lui_linger *);
+void lui_linger_save(lui_linger *);
+void lui_linger_pressure(lui_linger *);
+
+#define lui_linger_under_pressure(l) \
+	((l)->pressure_until > g_get_monotonic_time())
+
+#endif
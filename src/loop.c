@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "loop.h"
+
+static GMainContext *core_context;
+
+void lui_loop_set_context(GMainContext * context)
+{
+	core_context = context;
+}
+
+GMainContext *lui_loop_get_context(void)
+{
+	return core_context;
+}
+
+static guint loop_attach(GSource * source, GSourceFunc func, gpointer data)
+{
+	guint id;
+
+	g_source_set_callback(source, func, data, NULL);
+	id = g_source_attach(source, core_context);
+	g_source_unref(source);
+	return id;
+}
+
+guint lui_loop_timeout_add(guint ms, GSourceFunc func, gpointer data)
+{
+	return loop_attach(g_timeout_source_new(ms), func, data);
+}
+
+guint lui_loop_idle_add(gint priority, GSourceFunc func, gpointer data)
+{
+	GSource *source = g_idle_source_new();
+
+	g_source_set_priority(source, priority);
+	return loop_attach(source, func, data);
+}
+
+/* g_source_remove() only looks in the default context */
+void lui_loop_remove(guint id)
+{
+	GSource *source;
+
+	source = g_main_context_find_source_by_id(core_context, id);
+	if (source)
+		g_source_destroy(source);
+}
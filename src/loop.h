@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCATION_UI_LOOP_H__
+#define __LOCATION_UI_LOOP_H__
+
+#include <glib.h>
+
+/*
+ * Timers and idle callbacks of the dialog core. They run in the context
+ * of the bus thread rather than the default one, which belongs to GTK.
+ */
+void lui_loop_set_context(GMainContext *);
+GMainContext *lui_loop_get_context(void);
+guint lui_loop_timeout_add(guint, GSourceFunc, gpointer);
+guint lui_loop_idle_add(gint, GSourceFunc, gpointer);
+void lui_loop_remove(guint);
+
+#endif
@@ -16,16 +16,31 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include <locale.h>
 #include <libintl.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include <dbus/dbus.h>
-#include <dbus/dbus-glib-lowlevel.h>
-#include <glib.h>
-#include <gtk/gtk.h>
+#include <signal.h>
 
-#include <hildon/hildon.h>
+#include <glib.h>
+#include <glib-unix.h>
+
+#include "decisions.h"
+#include "linger.h"
+#include "loop.h"
+#include "memory.h"
+#include "outbox.h"
+#include "pqueue.h"
+#include "renderer.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "trace.h"
+#include "transport.h"
 
 /* macros */
 #define nelem(x) (sizeof (x) / sizeof *(x))
@@ -33,758 +48,2579 @@
 #define LUI_DBUS_NAME    "com.nokia.Location.UI"
 #define LUI_DBUS_DIALOG  LUI_DBUS_NAME".Dialog"
 #define LUI_DBUS_PATH    "/com/nokia/location/ui"
+#define LUI_DBUS_DIALOG_PATH LUI_DBUS_PATH"/dialog"
+
+/* Bus backend used unless --transport says otherwise */
+#ifndef LUI_TRANSPORT_DEFAULT
+#define LUI_TRANSPORT_DEFAULT "libdbus"
+#endif
+
+/* Maximum number of concurrent client request dialogs */
+#ifndef LUI_DIALOG_SLOTS
+#define LUI_DIALOG_SLOTS 64
+#endif
+
+/* Maximum number of hidden funcmap dialogs kept around for reuse */
+#define LUI_WIDGET_POOL_MAX 3
+
+/* Maximum number of entries in a display_batch/close_batch call */
+#define LUI_BATCH_MAX 32
+
+/* Identical client requests within this window share one dialog */
+#define LUI_COALESCE_WINDOW_MS 10000
+
+/* A queued dialog gains one priority level each time this long passes */
+#define LUI_AGING_MS 5000
+
+/* but no more than this many, it only catches up with the next class */
+#define LUI_AGING_MAX 1
+
+/* Maximum number of information notes shown in one stack */
+#define LUI_FOLD_MAX 16
+
+/* Response code of a dialog whose deadline passed before an answer */
+#define LUI_RESPONSE_EXPIRED (-2)
+
+#define LUI_ERROR_IN_USE  LUI_DBUS_NAME".Error.InUse"
+#define LUI_ERROR_TIMEOUT LUI_DBUS_NAME".Error.Timeout"
+#define LUI_ERROR_CLOSED  LUI_DBUS_NAME".Error.Closed"
 
 /* enums */
+/* Where a dialog's note is; dialog_active is what its caller asked for */
 enum {
-	STATE_0,
-	STATE_QUEUE,
-	STATE_2,
+	STATE_IDLE,
+	STATE_QUEUED,
+	STATE_SHOWN,	/* current, folded into the current stack or answered */
 };
 
+/* Arguments of a client request, strings point into msg or restored */
+typedef struct client_request {
+	lui_msg *msg;
+	char *restored;		/* after a restart, in place of msg */
+	int accepted;
+	const char *requestor;	/* SUPL server for location_default_supl */
+	const char *client;
+} client_request;
+
+struct client_request_table;
+struct location_ui_t;
+
+/* A display_and_wait call whose reply is held until there is an answer */
+typedef struct dialog_waiter {
+	struct location_ui_t *location_ui;
+	struct location_ui_dialog *dialog;
+	lui_msg *msg;
+	guint timeout_id;
+	GList link;		/* in location_ui_t.waiters */
+} dialog_waiter;
+
 typedef struct location_ui_dialog {
 	char *path;
-	GtkWidget *(*dialog_func)(void);
-	GtkWindow *window;
-	int state;
+	lui_dialog_kind kind;
+	lui_window *window;
+	int state;		/* STATE_*, shared through the leader */
 	int priority;
-	int dialog_active;
+	int boost;		/* aging, added to priority while queued */
+	gint64 queued_at;	/* monotonic, microseconds */
+	gint64 deadline;	/* monotonic, microseconds, 0 for none */
+	int dialog_active;	/* 0 idle, 1 displayed, 3 answered */
 	int dialog_response_code;
 	int some_dbus_arg;
+	guint id;		/* slab handle, 0 for the static funcmap dialogs */
+	const struct client_request_table *clireq;
+	client_request req;
+	gint64 created;
+	char *requester;	/* unique bus name the response goes to */
+	gboolean decided;	/* answered from the decision cache */
+	struct location_ui_dialog *leader;	/* set on coalesced requests */
+	struct location_ui_dialog *followers;	/* requests sharing our note */
+	struct location_ui_dialog *next_follower;
+	struct location_ui_dialog *fold_head;	/* stack we are shown in */
+	struct location_ui_dialog *folded;	/* other notes in our stack */
+	struct location_ui_dialog *next_folded;
+	lui_pqueue_node qnode;
+	GList pool_link;	/* data is set while the window is pooled */
+	lui_stats_group *stats;
+	gint64 stamps[LUI_STAMPS];
+	dialog_waiter *waiter;
 } location_ui_dialog;
 
+#define dialog_is_static(d) ((d)->id == 0)
+
+/* Information notes only need acknowledging, so they can share a window */
+#define dialog_is_note(d) \
+	((d)->kind == LUI_DIALOG_PRIVACY_INFORMATION || \
+	 (d)->kind == LUI_DIALOG_PRIVACY_TIMEOUT || \
+	 (d)->kind == LUI_DIALOG_PRIVACY_EXPIRED || \
+	 (d)->kind == LUI_DIALOG_DEFAULT_SUPL)
+
+#define dialog_stamp(d, which) \
+	lui_stats_stamp((d)->stats, (d)->stamps, (which))
+
+#define dialog_trace(d, type, arg) \
+	lui_trace((type), (d)->kind, (d)->id, (arg))
+
+#define dialog_from_qnode(n) \
+	((location_ui_dialog *)((char *)(n) - \
+				G_STRUCT_OFFSET(location_ui_dialog, qnode)))
+
+/*
+ * Client request dialogs are carved out of a fixed slab. A handle encodes
+ * slot index and generation as generation * LUI_DIALOG_SLOTS + index, so
+ * the object path of a recycled slot never resolves to its new occupant.
+ */
+typedef struct dialog_slot {
+	location_ui_dialog dialog;	/* must be first */
+	guint generation;
+	struct dialog_slot *next_free;
+	char path[sizeof(LUI_DBUS_DIALOG_PATH) + 10];
+} dialog_slot;
+
+typedef struct dialog_slab {
+	dialog_slot *slots;
+	dialog_slot *free_list;
+	guint in_use;
+} dialog_slab;
+
 typedef struct location_ui_t {
-	GList *dialogs;
+	GMainLoop *loop;
+	int *argc;
+	char ***argv;
+	gboolean ui_ready;
+	guint preinit_id;
+	gboolean answered;
+	GHashTable *paths;	/* object path -> location_ui_dialog */
+	dialog_slab slab;
+	GHashTable *dialog_methods;	/* member quark -> display_close_map */
+	GHashTable *root_methods;	/* member quark -> root_method_map */
+	GHashTable *client_methods;	/* member quark -> client_request_table */
+	GHashTable *coalesce;	/* open client request dialogs by content */
+	guint coalesced;
+	lui_pqueue queue;
 	location_ui_dialog *current_dialog;
-	DBusConnection *dbus;
+	const lui_transport *transport;
+	lui_outbox outbox;
+	const lui_renderer *renderer;
+	lui_stats stats;
+	lui_decisions decisions;
+	lui_snapshot snapshot;
+	GQueue waiters;		/* pending display_and_wait calls */
+	GQueue waited;		/* answered through one, closed after */
+	GQueue widget_pool;	/* idle funcmap windows, least recent first */
+	guint widget_pool_hits;
+	guint widget_pool_misses;
+	guint prewarm_id;
+	lui_linger linger;
 	guint inactivity_timeout_id;
+	guint auto_answer_id;
+	guint aging_id;
+	guint expiry_id;
+	gint64 expiry_at;	/* deadline the expiry timer is set for */
+	guint expired;
+	guint pressure_events;
+	guint notes_folded;
 } location_ui_t;
 
+/*
+ * Client requests are validated when they arrive; the widget is only
+ * built once the dialog is about to be presented.
+ */
 typedef struct client_request_table {
 	char *text;
-	GtkWidget *(*func)(DBusMessage *, DBusError *);
+	gboolean (*parse)(lui_msg *, client_request *, lui_msg_error *);
+	lui_dialog_kind kind;
+	lui_stats_group *stats;
 } client_request_table;
 
 typedef struct display_close_map {
 	const char *text;
-	DBusMessage *(*func)(location_ui_t *, GList *, DBusMessage *);
+	lui_msg *(*func)(location_ui_t *, location_ui_dialog *,
+			 lui_msg *);
 } display_close_map;
 
+typedef struct root_method_map {
+	const char *text;
+	lui_msg *(*func)(location_ui_t *, lui_msg *);
+} root_method_map;
+
 /* function declarations */
-static GtkWidget *create_privacy_verification_dialog(DBusMessage *,
-						     DBusError *);
-static GtkWidget *create_privacy_information_dialog(DBusMessage *, DBusError *);
-static GtkWidget *create_privacy_timeout_dialog(DBusMessage *, DBusError *);
-static GtkWidget *create_privacy_expired_dialog(DBusMessage *, DBusError *);
-static GtkWidget *create_default_supl_dialog(DBusMessage *, DBusError *);
-static GtkWidget *create_bt_disconnected_dialog(void);
-static GtkWidget *create_disclaimer_dialog(void);
-static GtkWidget *create_enable_gps_dialog(void);
-static GtkWidget *create_enable_network_dialog(void);
-static GtkWidget *create_positioning_dialog(void);
-static GtkWidget *create_agnss_dialog(void);
+static gboolean parse_privacy_args(lui_msg *, int, client_request *,
+				   lui_msg_error *);
+static gboolean parse_privacy_verification(lui_msg *, client_request *,
+					   lui_msg_error *);
+static gboolean parse_privacy_notification(lui_msg *, client_request *,
+					   lui_msg_error *);
+static gboolean parse_privacy_expired(lui_msg *, client_request *,
+				      lui_msg_error *);
+static gboolean parse_default_supl(lui_msg *, client_request *,
+				   lui_msg_error *);
+static gint compare_dialog_priority(const lui_pqueue_node *,
+				    const lui_pqueue_node *);
 static location_ui_dialog *find_next_dialog(location_ui_t *);
+static void startup_phase(const char *);
+static void ui_init(location_ui_t *);
+static gboolean on_ui_preinit(location_ui_t *);
 static int on_inactivity_timeout(location_ui_t *);
-static void on_dialog_response(GtkWidget *, int, location_ui_t *);
+static void arm_inactivity_timeout(location_ui_t *);
+static void on_dialog_response(gpointer, int, gpointer);
+static void dialog_answer(location_ui_t *, location_ui_dialog *, int);
+static gint compare_fold_order(gconstpointer, gconstpointer);
+static void dialog_fold_notes(location_ui_t *, location_ui_dialog *);
+static void dialog_build_stack(location_ui_t *, location_ui_dialog *);
+static void fold_release(location_ui_t *, location_ui_dialog *);
+static void fold_unlink(location_ui_dialog *);
 static void schedule_new_dialog(location_ui_t *);
-static DBusMessage *location_ui_display_dialog(location_ui_t *, GList *,
-					       DBusMessage *);
-static DBusMessage *location_ui_close_dialog(location_ui_t *, GList *,
-					     DBusMessage *);
-static int compare_dialog_path(location_ui_dialog *, const char *);
-static DBusHandlerResult on_client_request(DBusConnection *, DBusMessage *,
-					   gpointer);
-static DBusHandlerResult find_dbus_cb(DBusConnection *, DBusMessage *,
-				      gpointer);
+static gboolean on_auto_answer(location_ui_t *);
+static void dialog_build_window(location_ui_t *, location_ui_dialog *);
+static void dialog_acquire_window(location_ui_t *, location_ui_dialog *);
+static void dialog_release_window(location_ui_t *, location_ui_dialog *);
+static gboolean on_widget_pool_prewarm(location_ui_t *);
+static guint widget_pool_trim(location_ui_t *, guint);
+static void on_memory_pressure(gpointer);
+static void on_memory_trim(gpointer);
+static void display_parse_options(lui_msg_iter *, gint32 *, gint64 *);
+static lui_msg *location_ui_display_dialog(location_ui_t *,
+					   location_ui_dialog *,
+					   lui_msg *);
+static lui_msg *location_ui_close_dialog(location_ui_t *,
+					 location_ui_dialog *,
+					 lui_msg *);
+static gboolean dialog_display(location_ui_t *, location_ui_dialog *, int,
+			       int, gint64);
+static gboolean on_aging(location_ui_t *);
+static void expiry_arm(location_ui_t *, gint64);
+static gboolean on_expiry(location_ui_t *);
+static void dialog_expire(location_ui_t *, location_ui_dialog *);
+static guint snapshot_index(location_ui_dialog *);
+static void dialog_snapshot(location_ui_t *, location_ui_dialog *);
+static location_ui_dialog *snapshot_restore_request(location_ui_t *,
+						    lui_snapshot_record *);
+static void snapshot_restore_state(location_ui_t *, location_ui_dialog *,
+				   lui_snapshot_record *);
+static void snapshot_replay(location_ui_t *);
+static gboolean dialog_close(location_ui_t *, location_ui_dialog *);
+static gboolean batch_get_path(lui_msg_iter *, const char **);
+static lui_msg *location_ui_display_batch(location_ui_t *, lui_msg *);
+static lui_msg *location_ui_close_batch(location_ui_t *, lui_msg *);
+static void stats_append_counter(lui_msg_iter *, const char *, guint64);
+static lui_msg *location_ui_get_stats(location_ui_t *, lui_msg *);
+static lui_msg *location_ui_dump_trace(location_ui_t *, lui_msg *);
+static lui_msg *location_ui_get_memory(location_ui_t *, lui_msg *);
+static gboolean on_sigusr1(location_ui_t *);
+static gpointer bus_main(location_ui_t *);
+static void dialog_slab_init(dialog_slab *);
+static location_ui_dialog *dialog_slab_alloc(dialog_slab *);
+static void dialog_slab_free(dialog_slab *, location_ui_dialog *);
+static location_ui_dialog *dialog_slab_claim(dialog_slab *, guint);
+static location_ui_dialog *dialog_slot_open(dialog_slab *, dialog_slot *);
+static location_ui_dialog *dialog_slab_lookup(dialog_slab *, guint);
+static void dispatch_init(location_ui_t *);
+static void dispatch_add_dialog(location_ui_t *, location_ui_dialog *);
+static location_ui_dialog *dispatch_lookup_dialog(location_ui_t *,
+						  const char *);
+static gpointer dispatch_lookup_member(GHashTable *, lui_msg *);
+static guint coalesce_hash(gconstpointer);
+static gboolean coalesce_equal(gconstpointer, gconstpointer);
+static location_ui_dialog *dialog_coalesce(location_ui_t *,
+					  location_ui_dialog *);
+static location_ui_dialog *coalesce_find(location_ui_t *,
+					 location_ui_dialog *);
+static void coalesce_forget(location_ui_t *, location_ui_dialog *);
+static gboolean coalesce_wanted(location_ui_dialog *);
+static gboolean coalesce_withdraw(location_ui_t *, location_ui_dialog *);
+static gboolean coalesce_detach(location_ui_t *, location_ui_dialog *);
+static void dialog_emit_response(location_ui_t *, location_ui_dialog *);
+static void dialog_set_requester(location_ui_t *, location_ui_dialog *,
+				 lui_msg *);
+static lui_msg *location_ui_display_and_wait(location_ui_t *,
+					     location_ui_dialog *,
+					     lui_msg *);
+static void dialog_waiter_finish(location_ui_dialog *, lui_msg *);
+static void dialog_close_waited(location_ui_t *);
+static gboolean on_waiter_timeout(dialog_waiter *);
+static char *waiter_match_rule(lui_msg *);
+static lui_msg_result on_name_owner_changed(lui_msg *, gpointer);
+static lui_msg_result on_client_request(lui_msg *, gpointer);
+static lui_msg_result find_dbus_cb(lui_msg *, gpointer);
+static lui_msg_result on_object_request(lui_msg *, gpointer);
 
 /* variables */
 static struct client_request_table clireq_table[5] = {
-	{"location_verification", create_privacy_verification_dialog},
-	{"location_information", create_privacy_information_dialog},
-	{"location_timeout", create_privacy_timeout_dialog},
-	{"location_expired", create_privacy_expired_dialog},
-	{"location_default_supl", create_default_supl_dialog},
+	{"location_verification", parse_privacy_verification,
+	 LUI_DIALOG_PRIVACY_VERIFICATION},
+	{"location_information", parse_privacy_notification,
+	 LUI_DIALOG_PRIVACY_INFORMATION},
+	{"location_timeout", parse_privacy_notification,
+	 LUI_DIALOG_PRIVACY_TIMEOUT},
+	{"location_expired", parse_privacy_expired,
+	 LUI_DIALOG_PRIVACY_EXPIRED},
+	{"location_default_supl", parse_default_supl,
+	 LUI_DIALOG_DEFAULT_SUPL},
 };
 
 static struct location_ui_dialog funcmap[6] = {
 	{"/com/nokia/location/ui/bt_disconnected",
-	 create_bt_disconnected_dialog, NULL, 0, 0, 0, 0, 0},
+	 LUI_DIALOG_BT_DISCONNECTED, NULL, 0, 0, 0, 0, 0},
 	{"/com/nokia/location/ui/disclaimer",
-	 create_disclaimer_dialog, NULL, 0, 0, 0, 0, 0},
+	 LUI_DIALOG_DISCLAIMER, NULL, 0, 0, 0, 0, 0},
 	{"/com/nokia/location/ui/enable_gps",
-	 create_enable_gps_dialog, NULL, 0, 0, 0, 0, 0},
+	 LUI_DIALOG_ENABLE_GPS, NULL, 0, 0, 0, 0, 0},
 	{"/com/nokia/location/ui/enable_network",
-	 create_enable_network_dialog, NULL, 0, 0, 0, 0, 0},
+	 LUI_DIALOG_ENABLE_NETWORK, NULL, 0, 0, 0, 0, 0},
 	{"/com/nokia/location/ui/enable_positioning",
-	 create_positioning_dialog, NULL, 0, 0, 0, 0, 0},
+	 LUI_DIALOG_ENABLE_POSITIONING, NULL, 0, 0, 0, 0, 0},
 	{"/com/nokia/location/ui/enable_agnss",
-	 create_agnss_dialog, NULL, 0, 0, 0, 0, 0},
+	 LUI_DIALOG_ENABLE_AGNSS, NULL, 0, 0, 0, 0, 0},
 };
 
-static display_close_map dc_map[2] = {
+static display_close_map dc_map[3] = {
 	{"display", location_ui_display_dialog},
 	{"close", location_ui_close_dialog},
+	{"display_and_wait", location_ui_display_and_wait},
 };
 
-static DBusObjectPathVTable client_vtable = {
-	NULL, on_client_request, NULL, NULL, NULL, NULL,
+static root_method_map root_map[5] = {
+	{"display_batch", location_ui_display_batch},
+	{"close_batch", location_ui_close_batch},
+	{"get_stats", location_ui_get_stats},
+	{"dump_trace", location_ui_dump_trace},
+	{"get_memory", location_ui_get_memory},
 };
 
-static DBusObjectPathVTable find_cb_vtable = {
-	NULL, find_dbus_cb, NULL, NULL, NULL, NULL,
+static gint64 startup_time;
+static gboolean preinit;
+static gint linger_min = 5;
+static gint linger_max = 120;
+static gint auto_answer = -1;
+static gboolean broadcast_responses;
+static gint decision_ttl;
+static gboolean snapshot = TRUE;
+static gboolean fold_notes;
+static gchar *renderer_name = "hildon";
+static gchar *transport_name = LUI_TRANSPORT_DEFAULT;
+static gint think_ms;
+static gint think_jitter_ms;
+static gchar *answer_script;
+
+static GOptionEntry option_entries[] = {
+	{"preinit", 'p', 0, G_OPTION_ARG_NONE, &preinit,
+	 "Initialize the UI in the background after startup", NULL},
+	{"linger-min", 0, 0, G_OPTION_ARG_INT, &linger_min,
+	 "Shortest time to stay around when idle", "SECONDS"},
+	{"linger-max", 0, 0, G_OPTION_ARG_INT, &linger_max,
+	 "Longest time to stay around when idle", "SECONDS"},
+	{"auto-answer", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT, &auto_answer,
+	 "Accept every dialog this long after it is shown (benchmarking)",
+	 "MS"},
+	{"renderer", 0, 0, G_OPTION_ARG_STRING, &renderer_name,
+	 "Dialog backend, hildon or null (headless)", "NAME"},
+	{"transport", 0, 0, G_OPTION_ARG_STRING, &transport_name,
+	 "Bus backend, libdbus or gdbus as enabled at configure time", "NAME"},
+	{"think", 0, 0, G_OPTION_ARG_INT, &think_ms,
+	 "How long the null renderer takes to answer", "MS"},
+	{"think-jitter", 0, 0, G_OPTION_ARG_INT, &think_jitter_ms,
+	 "Random extra think time of the null renderer", "MS"},
+	{"answers", 0, 0, G_OPTION_ARG_STRING, &answer_script,
+	 "Response codes the null renderer gives in turn", "CODE,..."},
+	{"remember-decisions", 0, 0, G_OPTION_ARG_INT, &decision_ttl,
+	 "Answer repeated location verifications the same way for this long",
+	 "SECONDS"},
+	{"fold-notes", 0, 0, G_OPTION_ARG_NONE, &fold_notes,
+	 "Show queued information notes together, acknowledged once", NULL},
+	{"no-snapshot", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &snapshot,
+	 "Do not keep the dialog state across restarts", NULL},
+	{"broadcast-responses", 0, 0, G_OPTION_ARG_NONE, &broadcast_responses,
+	 "Broadcast response signals for clients that do not own the call",
+	 NULL},
+	{NULL}
 };
 
 /* function implementations */
-GtkWidget *create_privacy_verification_dialog(DBusMessage * msg,
-					      DBusError * err)
+gboolean parse_privacy_args(lui_msg * msg, int first_type,
+			    client_request * req, lui_msg_error * err)
 {
-	GtkWidget *ret;
-	int accepted;
-	char **arr;
-	int arrlen;
-	char *text, *unk_text;
-	gchar *text_dup;
-
-	if (!dbus_message_get_args
-	    (msg, err, DBUS_TYPE_INT32, &accepted, DBUS_TYPE_ARRAY,
-	     DBUS_TYPE_STRING, &arr, &arrlen, DBUS_TYPE_INVALID))
-		return NULL;
+	lui_msg_iter iter, sub;
+	gboolean flag;
+	int n = 0;
+
+	/* Iterate instead of lui_msg_get_args so nothing is copied */
+	if (!lui_msg_iter_init(msg, &iter) ||
+	    lui_msg_iter_get_arg_type(&iter) != first_type)
+		goto invalid;
+
+	if (first_type == LUI_TYPE_BOOLEAN) {
+		lui_msg_iter_get_basic(&iter, &flag);
+		req->accepted = flag;
+	} else {
+		lui_msg_iter_get_basic(&iter, &req->accepted);
+	}
 
-	if (arrlen != 2) {
-		dbus_set_error(err, "org.freedesktop.DBus.Error.Failed",
-			       "Provide requestor and client");
-		return NULL;
+	if (!lui_msg_iter_next(&iter) ||
+	    lui_msg_iter_get_arg_type(&iter) != LUI_TYPE_ARRAY ||
+	    lui_msg_iter_get_element_type(&iter) != LUI_TYPE_STRING)
+		goto invalid;
+
+	lui_msg_iter_recurse(&iter, &sub);
+	while (lui_msg_iter_get_arg_type(&sub) == LUI_TYPE_STRING) {
+		if (n == 0)
+			lui_msg_iter_get_basic(&sub, &req->requestor);
+		else if (n == 1)
+			lui_msg_iter_get_basic(&sub, &req->client);
+		n++;
+		lui_msg_iter_next(&sub);
 	}
 
-	switch (accepted) {
-	case 0:
-		text = dgettext(NULL, "loca_nc_request_default_reject");
-		break;
-	case 1:
-		text = dgettext(NULL, "loca_nc_request_default_accept");
-		break;
-	case -1:
-		text = dgettext(NULL, "loca_nc_request_no_default");
-		break;
-	default:
-		return NULL;
+	if (n != 2) {
+		lui_msg_set_error(err, LUI_BUS_ERROR_FAILED,
+				  "Provide requestor and client");
+		return FALSE;
 	}
 
-	/* TODO: review */
-	if (**arr)
-		unk_text = *arr;
-	else
-		unk_text = dgettext(NULL, "loca_va_unknown");
+	return TRUE;
 
-	text_dup = g_strdup_printf(text, unk_text);
-	ret = hildon_note_new_confirmation(NULL, text_dup);
-	g_free(text_dup);
-	return ret;
+invalid:
+	lui_msg_set_error(err, LUI_BUS_ERROR_INVALID_ARGS, "Expected (%s, as)",
+			  first_type == LUI_TYPE_BOOLEAN ? "b" : "i");
+	return FALSE;
 }
 
-GtkWidget *create_privacy_information_dialog(DBusMessage * msg, DBusError * err)
+gboolean parse_privacy_verification(lui_msg * msg, client_request * req,
+				    lui_msg_error * err)
 {
-	GtkWidget *ret;
-	int unused;
-	char **arr;
-	int arrlen;
-	char *text, *unk_text;
-	gchar *text_dup;
-
-	if (!dbus_message_get_args
-	    (msg, err, DBUS_TYPE_INT32, &unused, DBUS_TYPE_ARRAY,
-	     DBUS_TYPE_STRING, &arr, &arrlen, DBUS_TYPE_INVALID))
-		return NULL;
+	if (!parse_privacy_args(msg, LUI_TYPE_INT32, req, err))
+		return FALSE;
 
-	if (arrlen != 2) {
-		dbus_set_error(err, "org.freedesktop.DBus.Error.Failed",
-			       "Provide requestor and client");
-		return NULL;
+	if (req->accepted < -1 || req->accepted > 1) {
+		lui_msg_set_error(err, LUI_BUS_ERROR_INVALID_ARGS,
+				  "Invalid default %d", req->accepted);
+		return FALSE;
 	}
 
-	text = dgettext(NULL, "loca_ni_req_sent");
+	return TRUE;
+}
 
-	/* TODO: review */
-	if (**arr)
-		unk_text = *arr;
-	else
-		unk_text = dgettext(NULL, "loca_va_unknown");
+gboolean parse_privacy_notification(lui_msg * msg, client_request * req,
+				    lui_msg_error * err)
+{
+	return parse_privacy_args(msg, LUI_TYPE_INT32, req, err);
+}
 
-	text_dup = g_strdup_printf(text, unk_text);
-	ret = hildon_note_new_information(NULL, text_dup);
-	g_free(text_dup);
-	return ret;
+gboolean parse_privacy_expired(lui_msg * msg, client_request * req,
+			       lui_msg_error * err)
+{
+	return parse_privacy_args(msg, LUI_TYPE_BOOLEAN, req, err);
 }
 
-GtkWidget *create_privacy_timeout_dialog(DBusMessage * msg, DBusError * err)
+gboolean parse_default_supl(lui_msg * msg, client_request * req,
+			    lui_msg_error * err)
 {
-	GtkWidget *ret;
-	int accepted;
-	char **arr;
-	int arrlen;
-	char *text, *unk_text;
-	gchar *text_dup;
-
-	if (!dbus_message_get_args
-	    (msg, err, DBUS_TYPE_INT32, &accepted, DBUS_TYPE_ARRAY,
-	     DBUS_TYPE_STRING, &arr, &arrlen, DBUS_TYPE_INVALID))
-		return NULL;
+	return lui_msg_get_args(msg, err, LUI_TYPE_STRING,
+				&req->requestor, LUI_TYPE_INVALID);
+}
 
-	if (arrlen != 2) {
-		dbus_set_error(err, "org.freedesktop.DBus.Error.Failed",
-			       "Provide requestor and client");
-		return NULL;
+void dialog_build_window(location_ui_t * location_ui,
+			 location_ui_dialog * dialog)
+{
+	lui_dialog_args args;
+
+	args.accepted = dialog->req.accepted;
+	args.requestor = dialog->req.requestor;
+	dialog->window = location_ui->renderer->build(dialog->kind, &args,
+						      dialog);
+}
+
+/* Take a window out of the pool, building it on a miss */
+void dialog_acquire_window(location_ui_t * location_ui,
+			   location_ui_dialog * dialog)
+{
+	if (dialog->pool_link.data) {
+		g_queue_unlink(&location_ui->widget_pool, &dialog->pool_link);
+		dialog->pool_link.data = NULL;
+		location_ui->widget_pool_hits++;
+		return;
 	}
 
-	if (accepted)
-		text = dgettext(NULL, "loca_ni_accepted");
-	else
-		text = dgettext(NULL, "loca_ni_rejected");
+	if (dialog->window)
+		return;
 
-	/* TODO: review */
-	if (**arr)
-		unk_text = *arr;
-	else
-		unk_text = dgettext(NULL, "loca_va_unknown");
+	if (dialog_is_static(dialog))
+		location_ui->widget_pool_misses++;
+	dialog_build_window(location_ui, dialog);
+}
 
-	text_dup = g_strdup_printf(text, unk_text);
-	ret = hildon_note_new_information(NULL, text_dup);
-	g_free(text_dup);
-	return ret;
+/* Park a hidden funcmap window for the next display, evicting the LRU one */
+void dialog_release_window(location_ui_t * location_ui,
+			   location_ui_dialog * dialog)
+{
+	g_assert(dialog->pool_link.data == NULL);
+
+	location_ui->renderer->hide(dialog->window);
+	location_ui->renderer->reset(dialog->window);
+
+	dialog->pool_link.data = dialog;
+	g_queue_push_tail_link(&location_ui->widget_pool, &dialog->pool_link);
+	widget_pool_trim(location_ui,
+			 lui_linger_under_pressure(&location_ui->linger) ?
+			 0 : LUI_WIDGET_POOL_MAX);
 }
 
-GtkWidget *create_privacy_expired_dialog(DBusMessage * msg, DBusError * err)
+/* Destroy the least recently used windows beyond max, returns how many */
+guint widget_pool_trim(location_ui_t * location_ui, guint max)
 {
-	gboolean accepted;
-	char **arr;
-	int arrlen;
-	char *text;
+	location_ui_dialog *victim;
+	guint n = 0;
+
+	while (location_ui->widget_pool.length > max) {
+		victim = g_queue_pop_head_link(&location_ui->widget_pool)->data;
+		g_debug("%s: evicting %s", G_STRFUNC, victim->path);
+		victim->pool_link.data = NULL;
+		location_ui->renderer->destroy(victim->window);
+		victim->window = NULL;
+		n++;
+	}
 
-	if (!dbus_message_get_args(msg, err, DBUS_TYPE_BOOLEAN, &accepted,
-				   DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &arr,
-				   &arrlen, DBUS_TYPE_INVALID))
-		return NULL;
+	return n;
+}
 
-	if (arrlen != 2) {
-		dbus_set_error(err, "org.freedesktop.DBus.Error.Failed",
-			       "Provide requestor and client");
-		return NULL;
+/* Give back everything that only makes the next dialog faster */
+void on_memory_pressure(gpointer data)
+{
+	location_ui_t *location_ui = data;
+	guint freed;
+
+	location_ui->pressure_events++;
+
+	if (location_ui->prewarm_id) {
+		lui_loop_remove(location_ui->prewarm_id);
+		location_ui->prewarm_id = 0;
+	}
+	freed = widget_pool_trim(location_ui, 0);
+	lui_trace(LUI_TRACE_PRESSURE, LUI_TRACE_NO_KIND, 0, freed);
+
+	/* Leave early, and if already idle, sooner than planned */
+	lui_linger_pressure(&location_ui->linger);
+	if (location_ui->inactivity_timeout_id) {
+		lui_loop_remove(location_ui->inactivity_timeout_id);
+		location_ui->inactivity_timeout_id =
+		    lui_loop_timeout_add(location_ui->linger.min_ms,
+					 (GSourceFunc) on_inactivity_timeout,
+					 location_ui);
 	}
 
-	if (accepted)
-		text = dgettext(NULL, "loca_ni_accept_expired");
-	else
-		text = dgettext(NULL, "loca_ni_reject_expired");
+	/* The heap only shrinks once the UI thread has dropped the windows */
+	lui_renderer_thread_drained(on_memory_trim, location_ui);
+}
 
-	return hildon_note_new_information(NULL, text);
+void on_memory_trim(gpointer data)
+{
+	lui_memory_trim();
 }
 
-GtkWidget *create_default_supl_dialog(DBusMessage * msg, DBusError * err)
+/* Build one funcmap window per idle round until the pool is full */
+gboolean on_widget_pool_prewarm(location_ui_t * location_ui)
 {
-	GtkWidget *ret;
-	char *res, *text;
-	gchar *text_dup;
+	/* Most expensive first */
+	static const int order[] = { 1, 4, 2, 3, 5, 0 };
+	location_ui_dialog *dialog;
+	int i;
 
-	if (!dbus_message_get_args
-	    (msg, err, DBUS_TYPE_STRING, &res, DBUS_TYPE_INVALID))
-		return NULL;
+	if (location_ui->widget_pool.length >= LUI_WIDGET_POOL_MAX)
+		goto done;
 
-	text = dgettext(NULL, "loca_in_default_supl_used");
-	text_dup = g_strdup_printf(text, res);
-	ret = hildon_note_new_information(NULL, text_dup);
-	g_free(text_dup);
-	return ret;
+	for (i = 0; i < nelem(order); i++) {
+		dialog = &funcmap[order[i]];
+		if (dialog->window || dialog->dialog_active)
+			continue;
+
+		g_debug("%s: building %s", G_STRFUNC, dialog->path);
+		dialog_build_window(location_ui, dialog);
+		dialog_release_window(location_ui, dialog);
+		return TRUE;
+	}
+
+done:
+	location_ui->prewarm_id = 0;
+	return FALSE;
 }
 
-GtkWidget *create_bt_disconnected_dialog(void)
+gint compare_dialog_priority(const lui_pqueue_node * a,
+			     const lui_pqueue_node * b)
 {
-	char *t = dgettext(NULL, "loca_nc_bt_reconnect");
-	return hildon_note_new_confirmation(NULL, t);
+	location_ui_dialog *da = dialog_from_qnode(a);
+	location_ui_dialog *db = dialog_from_qnode(b);
+	int pa = da->priority + da->boost;
+	int pb = db->priority + db->boost;
+
+	/* Higher priority first */
+	if (pa != pb)
+		return (pa < pb) - (pa > pb);
+
+	/* Then earliest deadline, dialogs without one last, then FIFO */
+	if (da->deadline == db->deadline)
+		return 0;
+	if (!da->deadline || !db->deadline)
+		return da->deadline ? -1 : 1;
+	return da->deadline < db->deadline ? -1 : 1;
 }
 
-GtkWidget *create_disclaimer_dialog(void)
+location_ui_dialog *find_next_dialog(location_ui_t * location_ui)
 {
-	char *disclaimer_text, *disclaimer_ok, *disclaimer_reject;
-	char *fi_disclaimer_text;
-	GtkWidget *dialog, *label, *pan;
+	lui_pqueue_node *node;
+	location_ui_dialog *next_dialog;
+
+	node = lui_pqueue_peek(&location_ui->queue);
+	if (!node)
+		return NULL;
+
+	next_dialog = dialog_from_qnode(node);
+	g_assert(next_dialog->state == STATE_QUEUED);
+	return next_dialog;
+}
 
-	disclaimer_text = dgettext(NULL, "loca_ti_disclaimer");
-	disclaimer_ok = dgettext(NULL, "loca_bd_disclaimer_ok");
-	disclaimer_reject = dgettext(NULL, "loca_bd_disclaimer_reject");
+void startup_phase(const char *phase)
+{
+	g_debug("startup: %s at %.1f ms", phase,
+		(g_get_monotonic_time() - startup_time) / 1000.0);
+}
 
-	/* TODO: What is 42 below? */
-	dialog = gtk_dialog_new_with_buttons(disclaimer_text, NULL,
-					     GTK_DIALOG_NO_SEPARATOR,
-					     disclaimer_ok, GTK_RESPONSE_OK,
-					     disclaimer_reject, 42, NULL);
+/* The renderer is only loaded once something is to be shown */
+void ui_init(location_ui_t * location_ui)
+{
+	if (location_ui->ui_ready)
+		return;
 
-	fi_disclaimer_text = dgettext(NULL, "loca_fi_disclaimer");
-	label = gtk_label_new(fi_disclaimer_text);
-	gtk_label_set_line_wrap(GTK_LABEL(label), TRUE);
-	gtk_widget_set_name(label, "osso-SmallFont");
+	if (location_ui->preinit_id) {
+		lui_loop_remove(location_ui->preinit_id);
+		location_ui->preinit_id = 0;
+	}
 
-	pan = hildon_pannable_area_new();
-	hildon_pannable_area_add_with_viewport(HILDON_PANNABLE_AREA(pan), label);
-	g_object_set(G_OBJECT(pan), "hscrollbar-policy", 2, NULL);
-	gtk_widget_set_size_request(pan, -1, 350);
+	location_ui->renderer->init(location_ui->argc, location_ui->argv);
+	location_ui->ui_ready = TRUE;
+	startup_phase("ui ready");
 
-	gtk_box_pack_start(GTK_BOX(GTK_DIALOG(dialog)->vbox), pan, FALSE, TRUE, 0);
-	gtk_widget_show_all(dialog);
-	return dialog;
+	/* A warm pool is the first thing given up under memory pressure */
+	if (!lui_linger_under_pressure(&location_ui->linger))
+		location_ui->prewarm_id =
+		    lui_loop_idle_add(G_PRIORITY_LOW,
+				      (GSourceFunc) on_widget_pool_prewarm,
+				      location_ui);
 }
 
-GtkWidget *create_enable_gps_dialog(void)
+gboolean on_ui_preinit(location_ui_t * location_ui)
 {
-	char *t = dgettext(NULL, "loca_nc_switch_gps_on");
-	return hildon_note_new_confirmation(NULL, t);
+	location_ui->preinit_id = 0;
+	ui_init(location_ui);
+	return FALSE;
 }
 
-GtkWidget *create_enable_network_dialog(void)
+int on_inactivity_timeout(location_ui_t * location_ui)
 {
-	char *t = dgettext(NULL, "loca_nc_switch_network_on");
-	return hildon_note_new_confirmation(NULL, t);
+	g_assert(location_ui->current_dialog == NULL);
+	g_assert(find_next_dialog(location_ui) == NULL);
+	lui_trace(LUI_TRACE_TIMEOUT, LUI_TRACE_NO_KIND, 0, 0);
+	g_main_loop_quit(location_ui->loop);
+	location_ui->inactivity_timeout_id = 0;
+	return 0;
 }
 
-GtkWidget *create_positioning_dialog(void)
+/* (Re)start the idle period, the linger policy decides its length */
+void arm_inactivity_timeout(location_ui_t * location_ui)
 {
-	char *gps_on_text, *done_text, *gps_text, *net_text;
-	GtkWidget *dialog, *cb_gps, *cb_net;
+	guint delay;
+
+	if (location_ui->inactivity_timeout_id)
+		lui_loop_remove(location_ui->inactivity_timeout_id);
 
-	gps_on_text = dgettext(NULL, "loca_ti_switch_gps_network_on");
-	done_text = dgettext("hildon-libs", "wdgt_bd_done");
+	delay = lui_linger_idle(&location_ui->linger);
+	lui_trace(LUI_TRACE_IDLE, LUI_TRACE_NO_KIND, 0, delay / 1000);
+	location_ui->inactivity_timeout_id =
+	    lui_loop_timeout_add(delay, (GSourceFunc) on_inactivity_timeout,
+				 location_ui);
+}
 
-	dialog = gtk_dialog_new_with_buttons(gps_on_text, NULL,
-					     GTK_DIALOG_NO_SEPARATOR, done_text,
-					     GTK_RESPONSE_OK, NULL);
+void on_dialog_response(gpointer owner, int code, gpointer data)
+{
+	location_ui_t *location_ui = data;
+	location_ui_dialog *item = owner;
+	location_ui_dialog *folded;
+	gpointer cur_dialog;
 
-	cb_gps = hildon_check_button_new(HILDON_SIZE_FINGER_HEIGHT);
-	gps_text = dgettext(NULL, "loca_fi_gps");
-	gtk_button_set_label(GTK_BUTTON(cb_gps), gps_text);
-	gtk_box_pack_start(GTK_BOX(GTK_DIALOG(dialog)->vbox), cb_gps, FALSE, FALSE, 0);
-	gtk_widget_show(cb_gps);
-	g_object_set_data(G_OBJECT(dialog), "gps-cb", cb_gps);
+	dialog_answer(location_ui, item, code);
 
-	cb_net = hildon_check_button_new(HILDON_SIZE_FINGER_HEIGHT);
-	net_text = dgettext(NULL, "loca_fi_network");
-	gtk_button_set_label(GTK_BUTTON(cb_net), net_text);
-	gtk_box_pack_start(GTK_BOX(GTK_DIALOG(dialog)->vbox), cb_net, FALSE, FALSE, 0);
-	gtk_widget_show(cb_net);
-	g_object_set_data(G_OBJECT(dialog), "net-cb", cb_net);
+	/* Acknowledging a stack acknowledges every note in it */
+	while ((folded = item->folded)) {
+		item->folded = folded->next_folded;
+		folded->next_folded = NULL;
+		folded->fold_head = NULL;
+		dialog_answer(location_ui, folded, code);
+	}
 
-	return dialog;
+	/* An expired dialog may never have been built */
+	if (item->window)
+		location_ui->renderer->hide(item->window);
+	cur_dialog = location_ui->current_dialog;
+	if (cur_dialog == item) {
+		location_ui->current_dialog = NULL;
+		schedule_new_dialog(location_ui);
+	}
+
+	dialog_close_waited(location_ui);
 }
 
-GtkWidget *create_agnss_dialog(void)
+/* Record and send one dialog's answer, and its coalesced callers' */
+void dialog_answer(location_ui_t * location_ui, location_ui_dialog * item,
+		   int code)
 {
-	char *t = dgettext(NULL, "loca_nc_switch_network_and_gps_on");
-	return hildon_note_new_confirmation(NULL, t);
+	location_ui_dialog *follower;
+
+	item->dialog_response_code = code;
+	dialog_stamp(item, LUI_STAMP_RESPONDED);
+	dialog_trace(item, LUI_TRACE_RESPONSE, code);
+
+	dialog_emit_response(location_ui, item);
+
+	if (item->kind == LUI_DIALOG_PRIVACY_VERIFICATION &&
+	    !dialog_is_static(item) && code >= 0)
+		lui_decisions_store(&location_ui->decisions,
+				    item->req.requestor, item->req.client,
+				    item->req.accepted, code);
+
+	/* Every coalesced caller gets the same decision on its own path */
+	coalesce_forget(location_ui, item);
+	while ((follower = item->followers)) {
+		item->followers = follower->next_follower;
+		follower->next_follower = NULL;
+		follower->leader = NULL;
+		follower->dialog_response_code = item->dialog_response_code;
+		follower->dialog_active = 3;
+		dialog_emit_response(location_ui, follower);
+		dialog_snapshot(location_ui, follower);
+	}
+
+	item->dialog_active = 3;
+	dialog_snapshot(location_ui, item);
 }
 
-location_ui_dialog *find_next_dialog(location_ui_t * location_ui)
+/* Sort like the queue would, so the stack reads in scheduling order */
+gint compare_fold_order(gconstpointer a, gconstpointer b)
 {
-	g_debug(G_STRFUNC);
-	location_ui_dialog *next_dialog, *tmp_dialog;
-	gint32 cur_priority;
-	GList *dialog_list;
+	const lui_pqueue_node *na = *(const lui_pqueue_node * const *)a;
+	const lui_pqueue_node *nb = *(const lui_pqueue_node * const *)b;
+	gint ret = compare_dialog_priority(na, nb);
 
-	dialog_list = location_ui->dialogs;
-	if (!dialog_list) {
-		g_debug("%s: dialog_list is 0", G_STRLOC);
-		return NULL;
+	return ret ? ret : (na->seq > nb->seq) - (na->seq < nb->seq);
+}
+
+/* Take every other queued note out of the queue and into head's stack */
+void dialog_fold_notes(location_ui_t * location_ui, location_ui_dialog * head)
+{
+	lui_pqueue *queue = &location_ui->queue;
+	lui_pqueue_node *nodes[LUI_FOLD_MAX - 1];
+	location_ui_dialog *dialog, **link;
+	guint i, n = 0;
+
+	for (i = 0; i < lui_pqueue_length(queue) && n < G_N_ELEMENTS(nodes);
+	     i++)
+		if (dialog_is_note(dialog_from_qnode(queue->heap[i])))
+			nodes[n++] = queue->heap[i];
+
+	qsort(nodes, n, sizeof(*nodes), compare_fold_order);
+
+	link = &head->folded;
+	for (i = 0; i < n; i++) {
+		dialog = dialog_from_qnode(nodes[i]);
+		lui_pqueue_remove(queue, nodes[i]);
+		dialog->state = STATE_SHOWN;
+		dialog->fold_head = head;
+		*link = dialog;
+		link = &dialog->next_folded;
+		dialog_stamp(dialog, LUI_STAMP_SCHEDULE);
+		dialog_trace(dialog, LUI_TRACE_SCHEDULE, lui_pqueue_length(queue));
 	}
 
-	next_dialog = NULL;
-	/* I think this should be -1 */
-	cur_priority = 0x80000000;
+	location_ui->notes_folded += n;
+}
 
-	do {
-		while (1) {
-			tmp_dialog = dialog_list->data;
-			if (tmp_dialog->state == STATE_QUEUE) {
-				g_debug("it's state_queue");
-				break;
-			}
+void dialog_build_stack(location_ui_t * location_ui,
+			location_ui_dialog * head)
+{
+	lui_dialog_kind kinds[LUI_FOLD_MAX];
+	lui_dialog_args args[LUI_FOLD_MAX];
+	location_ui_dialog *dialog;
+	guint n = 0;
 
-			g_debug("it's NOT state_queue");
-			dialog_list = g_list_next(dialog_list);
-			if (!dialog_list) {
-				return next_dialog;
-			}
-		}
-		dialog_list = g_list_next(dialog_list);
-		if (tmp_dialog->priority > cur_priority) {
-			next_dialog = tmp_dialog;
-			cur_priority = tmp_dialog->priority;
-		}
-	} while (dialog_list);
+	if (head->window) {
+		location_ui->renderer->destroy(head->window);
+		head->window = NULL;
+	}
 
-	g_debug("%s final path: %s", G_STRFUNC, next_dialog->path);
-	return next_dialog;
+	for (dialog = head; dialog; dialog = dialog == head ?
+	     head->folded : dialog->next_folded) {
+		kinds[n] = dialog->kind;
+		args[n].accepted = dialog->req.accepted;
+		args[n].requestor = dialog->req.requestor;
+		n++;
+	}
+
+	head->window = location_ui->renderer->build_stack(n, kinds, args,
+							  head);
 }
 
-int on_inactivity_timeout(location_ui_t * location_ui)
+/* The head of a stack went away, what was folded into it queues again */
+void fold_release(location_ui_t * location_ui, location_ui_dialog * head)
 {
-	g_assert(location_ui->current_dialog == NULL);
-	g_assert(find_next_dialog(location_ui) == NULL);
-	gtk_main_quit();
-	return 0;
+	location_ui_dialog *dialog;
+
+	while ((dialog = head->folded)) {
+		head->folded = dialog->next_folded;
+		dialog->next_folded = NULL;
+		dialog->fold_head = NULL;
+		dialog->state = STATE_QUEUED;
+		lui_pqueue_push(&location_ui->queue, &dialog->qnode);
+	}
 }
 
-void on_dialog_response(GtkWidget * dialog, int gtk_response,
-			location_ui_t * location_ui)
+/* Leave a stack, the other notes in it stay */
+void fold_unlink(location_ui_dialog * dialog)
 {
-	location_ui_dialog *item;
-	GTypeInstance *gps_cb_data, *net_cb_data;
-	int gps_active_status, net_active_status, resp_code;
-	HildonCheckButton *gps_cb_button, *net_cb_button;
-	gboolean gps_button_active, net_button_active;
-	DBusMessage *msg;
-	gpointer cur_dialog;
+	location_ui_dialog **link;
 
-	item = g_object_get_data(G_OBJECT(dialog), "dialog-data");
-	g_assert(dialog != NULL);
+	for (link = &dialog->fold_head->folded; *link;
+	     link = &(*link)->next_folded) {
+		if (*link == dialog) {
+			*link = dialog->next_folded;
+			break;
+		}
+	}
 
-	item->dialog_response_code = 0;
-	gps_cb_data = g_object_get_data(G_OBJECT(dialog), "gps-cb");
-	net_cb_data = g_object_get_data(G_OBJECT(dialog), "net-cb");
+	dialog->fold_head = NULL;
+	dialog->next_folded = NULL;
+}
 
-	if (gps_cb_data && net_cb_data) {
-		gps_cb_button = HILDON_CHECK_BUTTON(gps_cb_data);
-		net_cb_button = HILDON_CHECK_BUTTON(net_cb_data);
-		gps_button_active = hildon_check_button_get_active(gps_cb_button);
-		net_button_active = hildon_check_button_get_active(net_cb_button);
+void dialog_emit_response(location_ui_t * location_ui,
+			  location_ui_dialog * dialog)
+{
+	lui_msg *msg;
+
+	/* A waiting caller gets the answer as its reply instead */
+	if (dialog->waiter) {
+		msg = lui_msg_new_method_return(dialog->waiter->msg);
+		lui_msg_append_args(msg, LUI_TYPE_INT32,
+				    &dialog->dialog_response_code,
+				    LUI_TYPE_INVALID);
+		dialog_waiter_finish(dialog, msg);
+		g_queue_push_tail(&location_ui->waited, dialog);
+		return;
+	}
 
-		gps_active_status = item->dialog_response_code;
+	msg = lui_msg_new_signal(dialog->path, LUI_DBUS_DIALOG, "response");
+	lui_msg_append_args(msg, LUI_TYPE_INT32,
+			    &dialog->dialog_response_code,
+			    LUI_TYPE_INVALID);
 
-		if (gps_button_active)
-			gps_active_status |= 1u;
+	/* Only wake the caller, not every match rule on the system bus */
+	if (!broadcast_responses && dialog->requester)
+		lui_msg_set_destination(msg, dialog->requester);
 
-		if (net_button_active)
-			net_active_status = 2;
-		else
-			net_active_status = 0;
+	lui_outbox_push(&location_ui->outbox, msg);
+}
 
-		item->dialog_response_code = gps_active_status | net_active_status;
-	} else if (gtk_response == GTK_RESPONSE_OK) {
-		/* ok/accepted */
-		item->dialog_response_code = 0;
-	} else {
-		if (gtk_response == GTK_RESPONSE_CANCEL)
-			resp_code = 1;
-		else
-			/* unknown/invalid ? */
-			/* TODO: At least gets triggered when /disclaimer is Rejected */
-			resp_code = -1;
-		item->dialog_response_code = resp_code;
-	}
-
-	g_message("%s: response=%d", G_STRFUNC, item->dialog_response_code);
-
-	msg = dbus_message_new_signal(item->path, LUI_DBUS_DIALOG, "response");
-	dbus_message_append_args(msg, DBUS_TYPE_INT32,
-				 &item->dialog_response_code,
-				 DBUS_TYPE_INVALID);
-	dbus_connection_send(location_ui->dbus, msg, NULL);
-	dbus_connection_flush(location_ui->dbus);
-	dbus_message_unref(msg);
-	gtk_widget_hide(dialog);
-	cur_dialog = location_ui->current_dialog;
-	item->dialog_active = 3;
-	if (cur_dialog == item) {
-		location_ui->current_dialog = NULL;
-		schedule_new_dialog(location_ui);
-	}
+/* Remember who asked, the latest display call wins */
+void dialog_set_requester(location_ui_t * location_ui,
+			  location_ui_dialog * dialog, lui_msg * msg)
+{
+	const char *sender = lui_msg_get_sender(msg);
+
+	if (g_strcmp0(dialog->requester, sender) == 0)
+		return;
+
+	g_free(dialog->requester);
+	dialog->requester = g_strdup(sender);
+	dialog_snapshot(location_ui, dialog);
 }
 
 void schedule_new_dialog(location_ui_t * location_ui)
 {
-	g_debug(G_STRFUNC);
-	gpointer destroy_data;
+	guint hits;
 
 	g_assert(location_ui->current_dialog == NULL);
 	location_ui->current_dialog = find_next_dialog(location_ui);
 
 	if (location_ui->current_dialog) {
-		g_assert(location_ui->current_dialog->state == STATE_QUEUE);
-
-		destroy_data = location_ui->current_dialog->window;
-		location_ui->current_dialog->state = STATE_2;
-
-		if (location_ui->current_dialog->window == NULL) {
-			location_ui->current_dialog->window =
-			    GTK_WINDOW(location_ui->current_dialog->
-				       dialog_func());
-			g_object_set_data(G_OBJECT
-					  (location_ui->current_dialog->window),
-					  "dialog-data",
+		g_assert(location_ui->current_dialog->state == STATE_QUEUED);
+		lui_pqueue_remove(&location_ui->queue,
+				  &location_ui->current_dialog->qnode);
+
+		location_ui->current_dialog->state = STATE_SHOWN;
+		dialog_stamp(location_ui->current_dialog, LUI_STAMP_SCHEDULE);
+		dialog_trace(location_ui->current_dialog, LUI_TRACE_SCHEDULE,
+			     lui_pqueue_length(&location_ui->queue));
+
+		if (fold_notes && dialog_is_note(location_ui->current_dialog))
+			dialog_fold_notes(location_ui,
 					  location_ui->current_dialog);
-			g_signal_connect_data(location_ui->
-					      current_dialog->window,
-					      "response",
-					      (GCallback) on_dialog_response,
-					      location_ui,
-					      /* TODO: this seems wrong */
-					      (GClosureNotify) destroy_data,
-					      (GConnectFlags) destroy_data);
+
+		ui_init(location_ui);
+		hits = location_ui->widget_pool_hits;
+		if (location_ui->current_dialog->folded)
+			dialog_build_stack(location_ui,
+					   location_ui->current_dialog);
+		else
+			dialog_acquire_window(location_ui,
+					      location_ui->current_dialog);
+		dialog_stamp(location_ui->current_dialog, LUI_STAMP_BUILT);
+		location_ui->renderer->present(location_ui->current_dialog->
+					       window);
+		dialog_stamp(location_ui->current_dialog, LUI_STAMP_PRESENTED);
+		dialog_trace(location_ui->current_dialog, LUI_TRACE_PRESENT,
+			     location_ui->widget_pool_hits != hits);
+
+		if (auto_answer >= 0) {
+			if (location_ui->auto_answer_id)
+				lui_loop_remove(location_ui->auto_answer_id);
+			location_ui->auto_answer_id =
+			    lui_loop_timeout_add(auto_answer,
+						 (GSourceFunc) on_auto_answer,
+						 location_ui);
 		}
-		gtk_window_present(location_ui->current_dialog->window);
 
 		if (location_ui->inactivity_timeout_id) {
-			g_source_remove(location_ui->inactivity_timeout_id);
+			lui_loop_remove(location_ui->inactivity_timeout_id);
 			location_ui->inactivity_timeout_id = 0;
 		}
 	} else if (!location_ui->inactivity_timeout_id) {
-		location_ui->inactivity_timeout_id = g_timeout_add(15000u,
-								   (GSourceFunc)
-								   on_inactivity_timeout,
-								   location_ui);
+		arm_inactivity_timeout(location_ui);
 	}
 }
 
-DBusMessage *location_ui_display_dialog(location_ui_t * location_ui,
-					GList * list, DBusMessage * msg)
+/* Stands in for the user when driven by the load generator */
+gboolean on_auto_answer(location_ui_t * location_ui)
 {
-	int some_dbus_arg;
-	location_ui_dialog *dialog;
+	location_ui->auto_answer_id = 0;
 
-	if (!dbus_message_get_args
-	    (msg, NULL, DBUS_TYPE_INT32, &some_dbus_arg, DBUS_TYPE_INVALID))
-		some_dbus_arg = 0;
+	if (location_ui->current_dialog)
+		location_ui->renderer->answer(location_ui->current_dialog->
+					      window);
 
-	dialog = list->data;
+	return FALSE;
+}
 
+/* Queue a dialog without scheduling, FALSE if it is already in use */
+gboolean dialog_display(location_ui_t * location_ui,
+			location_ui_dialog * dialog, int some_dbus_arg,
+			int priority, gint64 deadline)
+{
 	if (dialog->dialog_active)
-		return dbus_message_new_error_printf(msg,
-						     "com.nokia.Location.UI.Error.InUse",
-						     "%d",
-						     dialog->dialog_response_code);
+		return FALSE;
+
+	/* Inherited a note that is already queued or shown */
+	if (dialog->state != STATE_IDLE) {
+		dialog->dialog_active = 1;
+		dialog_snapshot(location_ui, dialog);
+		return TRUE;
+	}
 
 	dialog->some_dbus_arg = some_dbus_arg;
-	/* TODO: dialog_active and state is the same? */
+
+	/* A repeated decision needs neither the queue nor the UI */
+	if (dialog->decided) {
+		dialog->dialog_active = 3;
+		dialog_trace(dialog, LUI_TRACE_RESPONSE,
+			     dialog->dialog_response_code);
+		dialog_snapshot(location_ui, dialog);
+		return TRUE;
+	}
+
 	dialog->dialog_active = 1;
-	dialog->state = 1;
-	if (location_ui->current_dialog == NULL)
-		schedule_new_dialog(location_ui);
-	return dbus_message_new_method_return(msg);
+
+	/* A coalesced request is shown through its leader's note, queued
+	 * once for everyone; the leader's own caller may not have displayed
+	 * it, so its dialog_active is left alone */
+	if (dialog->leader) {
+		dialog_snapshot(location_ui, dialog);
+		dialog = dialog->leader;
+		if (dialog->state != STATE_IDLE)
+			return TRUE;
+		dialog->some_dbus_arg = some_dbus_arg;
+	}
+
+	dialog->priority = priority;
+	dialog->boost = 0;
+	dialog->queued_at = g_get_monotonic_time();
+	dialog->deadline = deadline;
+	dialog->state = STATE_QUEUED;
+	lui_stats_stamp(dialog->stats, dialog->stamps, LUI_STAMP_ENQUEUE);
+	dialog_trace(dialog, LUI_TRACE_ENQUEUE, priority);
+	lui_pqueue_push(&location_ui->queue, &dialog->qnode);
+	dialog_snapshot(location_ui, dialog);
+
+	if (!location_ui->aging_id)
+		location_ui->aging_id =
+		    lui_loop_timeout_add(LUI_AGING_MS, (GSourceFunc) on_aging,
+					 location_ui);
+	expiry_arm(location_ui, deadline);
+	return TRUE;
 }
 
-DBusMessage *location_ui_close_dialog(location_ui_t * location_ui, GList * list,
-				      DBusMessage * msg)
+/* Raise everything queued by how long it has waited, so nothing starves */
+gboolean on_aging(location_ui_t * location_ui)
 {
+	lui_pqueue *queue = &location_ui->queue;
+	lui_pqueue_node **nodes;
 	location_ui_dialog *dialog;
-	DBusMessage *new_msg;
-	GList *dialogs;
-	int note_type;
-	char *dbus_obj_path;
+	gint64 now = g_get_monotonic_time();
+	guint i, n = lui_pqueue_length(queue);
+	int boost;
 
-	dialog = list->data;
-
-	new_msg = dbus_message_new_method_return(msg);
-	dbus_message_append_args(new_msg, DBUS_TYPE_INT32,
-				 dialog->dialog_response_code,
-				 DBUS_TYPE_INVALID);
+	if (!n) {
+		location_ui->aging_id = 0;
+		return FALSE;
+	}
 
-	/* TODO: Review */
-	if (dialog->window) {
-		if (HILDON_IS_NOTE(dialog->window)) {
-			note_type = 0;
-			g_object_get(G_OBJECT(dialog->window), "note-type",
-				     &note_type, NULL);
-			if ((unsigned int)(note_type - 2) > 1)
-				gtk_widget_destroy(GTK_WIDGET(dialog->window));
-		} else {
-			gtk_widget_destroy(GTK_WIDGET(dialog->window));
+	/* Updates move nodes around in the heap, so walk a copy */
+	nodes = g_newa(lui_pqueue_node *, n);
+	memcpy(nodes, queue->heap, n * sizeof(*nodes));
+	for (i = 0; i < n; i++) {
+		dialog = dialog_from_qnode(nodes[i]);
+		boost = MIN((now - dialog->queued_at) /
+			    (LUI_AGING_MS * G_TIME_SPAN_MILLISECOND),
+			    LUI_AGING_MAX);
+		if (boost != dialog->boost) {
+			dialog->boost = boost;
+			lui_pqueue_update(queue, nodes[i]);
 		}
-		dialog->window = NULL;
 	}
 
-	if (dialog->dialog_func) {
-		dialog->dialog_active = 0;
-		dialog->some_dbus_arg = 0;
-		dialog->dialog_response_code = -1;
-	} else {
-		dialogs = g_list_delete_link(location_ui->dialogs, list);
-		dbus_obj_path = dialog->path;
-		location_ui->dialogs = dialogs;
-		dbus_connection_unregister_object_path(location_ui->dbus,
-						       dbus_obj_path);
-		g_free(dialog->path);
-		g_slice_free1(24u, dialog);	/* TODO: (sizeof(location_ui_dialog), dialog) ? */
-	}
-
-	/* TODO: state? */
-	if (dialog->dialog_active == 2) {
-		g_assert(location_ui->current_dialog == dialog);
-		location_ui->current_dialog = NULL;
-		schedule_new_dialog(location_ui);
+	return TRUE;
+}
+
+/* Make sure the expiry timer fires no later than deadline */
+void expiry_arm(location_ui_t * location_ui, gint64 deadline)
+{
+	gint64 now;
+
+	if (!deadline ||
+	    (location_ui->expiry_id && location_ui->expiry_at <= deadline))
+		return;
+
+	if (location_ui->expiry_id)
+		lui_loop_remove(location_ui->expiry_id);
+
+	now = g_get_monotonic_time();
+	location_ui->expiry_at = deadline;
+	location_ui->expiry_id =
+	    lui_loop_timeout_add(deadline > now ?
+				 (deadline - now + 999) / 1000 : 0,
+				 (GSourceFunc) on_expiry, location_ui);
+}
+
+gboolean on_expiry(location_ui_t * location_ui)
+{
+	lui_pqueue *queue = &location_ui->queue;
+	location_ui_dialog **dialogs, *dialog;
+	gint64 now = g_get_monotonic_time(), next = 0;
+	guint i, n = lui_pqueue_length(queue);
+
+	location_ui->expiry_id = 0;
+
+	/* Queued ones go first, so none of them is presented just to expire,
+	 * then the notes folded into the current stack, then its head */
+	dialogs = g_newa(location_ui_dialog *, n + LUI_FOLD_MAX);
+	for (i = 0; i < n; i++)
+		dialogs[i] = dialog_from_qnode(queue->heap[i]);
+	if ((dialog = location_ui->current_dialog)) {
+		for (dialog = dialog->folded; dialog; dialog = dialog->next_folded)
+			dialogs[n++] = dialog;
+		dialogs[n++] = location_ui->current_dialog;
 	}
 
-	return new_msg;
+	for (i = 0; i < n; i++) {
+		dialog = dialogs[i];
+		if (!dialog->deadline || dialog->dialog_active == 3)
+			continue;
+
+		if (dialog->deadline <= now)
+			dialog_expire(location_ui, dialog);
+		else if (!next || dialog->deadline < next)
+			next = dialog->deadline;
+	}
+
+	expiry_arm(location_ui, next);
+	return FALSE;
 }
 
-int compare_dialog_path(location_ui_dialog * dialog, const char *path)
+/* Answer a dialog whose deadline passed, whether queued, shown or folded;
+ * only that one expires, the rest of its stack is still to be answered */
+void dialog_expire(location_ui_t * location_ui, location_ui_dialog * dialog)
 {
-	return strcmp(dialog->path, path);
+	location_ui_dialog *head = dialog->fold_head;
+
+	if (lui_pqueue_node_queued(&dialog->qnode)) {
+		lui_pqueue_remove(&location_ui->queue, &dialog->qnode);
+		dialog->state = STATE_SHOWN;
+	}
+
+	if (head) {
+		fold_unlink(dialog);
+		dialog_build_stack(location_ui, head);
+		location_ui->renderer->present(head->window);
+	} else if (dialog->folded) {
+		fold_release(location_ui, dialog);
+	}
+
+	location_ui->expired++;
+	on_dialog_response(dialog, LUI_RESPONSE_EXPIRED, location_ui);
 }
 
-DBusHandlerResult on_client_request(DBusConnection * conn, DBusMessage * msg,
-				    gpointer data)
+/* Slab dialogs keep their slot, the static ones follow */
+guint snapshot_index(location_ui_dialog * dialog)
 {
-	/* TODO: */
-	g_message(G_STRFUNC);
-	const char *member = dbus_message_get_member(msg);
-	g_debug("member=%s", member);
-	return 0;
-#if 0
-signed int __fastcall on_client_request(int a1, DBusMessage *msg, location_ui *locui)
-{
-  int vtable_idx; // r4
-  const char *v5; // r6
-  int v7; // r5
-  dialog_data *v8; // r0
-  dialog_data *dialog; // r4
-  char *dialog_path; // r0
-  GList *new_dialogs; // r0
-  char *dbus_path; // r1
-  GObject *v13; // r0
-  DBusMessage *new_msg; // r5
-  DBusMessage *method_call; // [sp+Ch] [bp-38h]
-  DBusError error; // [sp+10h] [bp-34h]
-
-  method_call = msg;
-  vtable_idx = 0;
-  v5 = dbus_message_get_member(msg);
-  while ( !g_str_equal(v5, (&create_dialog_vtable)[2 * vtable_idx]) )
-  {
-    if ( ++vtable_idx == 5 )
-      return 1;
-  }
-  dbus_error_init(&error);
-  v7 = ((int (__fastcall *)(DBusMessage *, DBusError *))(&create_dialog_vtable)[2 * vtable_idx + 1])(
-         method_call,
-         &error);
-  if ( v7 )
-  {
-    g_assert(!dbus_error_is_set(&error));
-    v8 = (dialog_data *)g_slice_alloc0(0x18u);
-    ++locui[1].dialogs;                         // not sure what this does
-    dialog = v8;
-    v8->window = (GtkWindow *)v7;
-    dialog_path = g_strdup_printf("/com/nokia/location/ui/dialog%d");
-    dialog->dialog_active = 0;
-    dialog->dialog_response_code = -1;
-    dialog->dbus_object_path = dialog_path;
-    new_dialogs = g_list_append(locui->dialogs, dialog);
-    dbus_path = dialog->dbus_object_path;
-    locui->dialogs = new_dialogs;
-    dbus_connection_register_object_path(locui->dbus, dbus_path, &find_callback_vtable, locui);
-    v13 = (GObject *)g_type_check_instance_cast(
-                       &dialog->window->bin.container.widget.object.parent_instance.g_type_instance,
-                       0x50u);
-    g_object_set_data(v13, "dialog-data", dialog);
-    g_signal_connect_data(dialog->window, "response", (GCallback)on_dialog_response, locui, 0, 0);
-    new_msg = dbus_message_new_method_return(method_call);
-    dbus_message_append_args(new_msg, 111, &dialog->dbus_object_path, 0);
-  }
-  else
-  {
-    g_assert(dbus_error_is_set(&error));
-    new_msg = dbus_message_new_error(method_call, error.name, error.message);
-    dbus_error_free(&error);
-  }
-  dbus_connection_send(locui->dbus, new_msg, 0);
-  dbus_connection_flush(locui->dbus);
-  dbus_message_unref(new_msg);
-  return 0;
+	if (dialog_is_static(dialog))
+		return LUI_DIALOG_SLOTS + (dialog - funcmap);
+	return dialog->id % LUI_DIALOG_SLOTS;
 }
-#endif
+
+/* Mirror the dialog into the snapshot after any change worth keeping */
+void dialog_snapshot(location_ui_t * location_ui, location_ui_dialog * dialog)
+{
+	lui_snapshot_record *rec;
+
+	rec = lui_snapshot_begin(&location_ui->snapshot,
+				 snapshot_index(dialog));
+	if (!rec || (dialog_is_static(dialog) && !dialog->dialog_active))
+		return;
+
+	rec->id = dialog->id;
+	rec->kind = dialog->kind;
+	rec->active = dialog->dialog_active;
+	rec->code = dialog->dialog_response_code;
+	rec->arg = dialog->some_dbus_arg;
+	rec->priority = dialog->priority;
+	rec->accepted = dialog->req.accepted;
+	if (dialog->deadline)
+		rec->deadline = dialog->deadline - g_get_monotonic_time() +
+		    g_get_real_time();
+	if (dialog->req.requestor)
+		rec->flags |= LUI_SNAPSHOT_REQUESTOR;
+	if (dialog->req.client)
+		rec->flags |= LUI_SNAPSHOT_CLIENT;
+	if (dialog->decided)
+		rec->flags |= LUI_SNAPSHOT_DECIDED;
+
+	/* Better not to restore a dialog than to restore it cut short */
+	if (lui_snapshot_copy(rec->requester, dialog->requester,
+			      sizeof(rec->requester)) &&
+	    lui_snapshot_copy(rec->requestor, dialog->req.requestor,
+			      sizeof(rec->requestor)) &&
+	    lui_snapshot_copy(rec->client, dialog->req.client,
+			      sizeof(rec->client)))
+		lui_snapshot_commit(rec);
 }
 
-DBusHandlerResult find_dbus_cb(DBusConnection * conn, DBusMessage * in_msg,
-			       gpointer data)
+location_ui_dialog *snapshot_restore_request(location_ui_t * location_ui,
+					     lui_snapshot_record * rec)
 {
-	location_ui_t *location_ui = (location_ui_t *) data;
-	const char *member, *message_path;
-	int i, idx = -1;
-	DBusMessage *out_msg;
-	GList *dialog_entry;
+	client_request_table *request = NULL;
+	location_ui_dialog *dialog;
+	const char *text;
+	int i;
 
-	member = dbus_message_get_member(in_msg);
-	message_path = dbus_message_get_path(in_msg);
+	for (i = 0; i < nelem(clireq_table); i++)
+		if (clireq_table[i].kind == rec->kind)
+			request = &clireq_table[i];
 
-	g_debug("%s: member=%s; path=%s", G_STRFUNC, member, message_path);
+	if (!request || !(dialog = dialog_slab_claim(&location_ui->slab,
+						      rec->id)))
+		return NULL;
 
-	for (i = 0; i < nelem(dc_map); i++) {
-		if (g_str_equal(member, dc_map[i].text)) {
-			idx = i;
-			break;
-		}
+	/* There is no request to point into, the strings get a copy */
+	dialog->req.restored = g_malloc(sizeof(rec->requestor) +
+					sizeof(rec->client));
+	text = memcpy(dialog->req.restored, rec->requestor,
+		      sizeof(rec->requestor));
+	if (rec->flags & LUI_SNAPSHOT_REQUESTOR)
+		dialog->req.requestor = text;
+	text = memcpy(dialog->req.restored + sizeof(rec->requestor),
+		      rec->client, sizeof(rec->client));
+	if (rec->flags & LUI_SNAPSHOT_CLIENT)
+		dialog->req.client = text;
+
+	dialog->req.accepted = rec->accepted;
+	dialog->clireq = request;
+	dialog->kind = request->kind;
+	dialog->stats = request->stats;
+	dialog->created = g_get_monotonic_time();
+	dialog->decided = (rec->flags & LUI_SNAPSHOT_DECIDED) != 0;
+	return dialog;
+}
+
+void snapshot_restore_state(location_ui_t * location_ui,
+			    location_ui_dialog * dialog,
+			    lui_snapshot_record * rec)
+{
+	gint64 deadline = 0;
+
+	g_free(dialog->requester);
+	dialog->requester = rec->requester[0] ?
+	    g_strdup(rec->requester) : NULL;
+	dialog->priority = rec->priority;
+	dialog->dialog_response_code = rec->code;
+
+	/* Answered, the response only needs to be picked up */
+	if (rec->active == 3) {
+		dialog->some_dbus_arg = rec->arg;
+		dialog->dialog_active = 3;
+		dialog->state = STATE_SHOWN;
+		dialog_snapshot(location_ui, dialog);
+		return;
 	}
-	if (idx < 0)
-		return 1;
 
-	dialog_entry = g_list_find_custom(location_ui->dialogs, message_path,
-					  (GCompareFunc) compare_dialog_path);
+	if (!dialog_is_static(dialog) && !dialog->decided)
+		dialog_coalesce(location_ui, dialog);
 
-	if (dialog_entry)
-		out_msg = dc_map[idx].func(location_ui, dialog_entry, in_msg);
-	else
-		out_msg = dbus_message_new_error(in_msg,
-				"org.freedesktop.DBus.Error.Failed", "Bad object");
+	if (!rec->active) {
+		dialog_snapshot(location_ui, dialog);
+		return;
+	}
 
-	dbus_connection_send(location_ui->dbus, out_msg, NULL);
-	dbus_connection_flush(location_ui->dbus);
-	dbus_message_unref(out_msg);
-	return 0;
+	/* Overdue ones expire as soon as the loop runs */
+	if (rec->deadline)
+		deadline = g_get_monotonic_time() +
+		    MAX(rec->deadline - g_get_real_time(), 0);
+	dialog_display(location_ui, dialog, rec->arg, rec->priority, deadline);
 }
 
-int main(int argc, char **argv, char **envp)
+/* Bring back what the previous instance left, before any call arrives */
+void snapshot_replay(location_ui_t * location_ui)
 {
-	int i;
-	const char *path;
-	location_ui_t location_ui;
+	lui_snapshot *snap = &location_ui->snapshot;
+	lui_snapshot_record *rec;
+	location_ui_dialog *dialog;
+	guint i;
+
+	for (i = 0; i < snap->records; i++) {
+		rec = &snap->record[i];
+		if (!g_atomic_int_get(&rec->used))
+			continue;
+
+		if (i >= LUI_DIALOG_SLOTS)
+			dialog = rec->id ? NULL :
+			    &funcmap[i - LUI_DIALOG_SLOTS];
+		else if (rec->id % LUI_DIALOG_SLOTS == i)
+			dialog = snapshot_restore_request(location_ui, rec);
+		else
+			dialog = NULL;
 
-	setlocale(LC_ALL, "");
-	bindtextdomain("osso-location-ui", "/usr/share/locale");
-	bind_textdomain_codeset("osso-location-ui", "UTF-8");
-	textdomain("osso-location-ui");
+		if (!dialog) {
+			lui_snapshot_clear(snap, i);
+			continue;
+		}
 
-	gtk_init(&argc, &argv);
+		snapshot_restore_state(location_ui, dialog, rec);
+		snap->restored++;
+	}
 
-	location_ui.dialogs = NULL;
-	location_ui.current_dialog = NULL;
-	location_ui.dbus = NULL;
-	location_ui.inactivity_timeout_id = 0;
+	if (snap->restored)
+		g_message("snapshot: %u dialogs restored", snap->restored);
+}
 
-	location_ui.dbus = dbus_bus_get(DBUS_BUS_SYSTEM, NULL);
-	if (!location_ui.dbus) {
-		g_critical("Failed to init DBus");
-		return 1;
-	}
+/* The optional [i priority [, u deadline_ms]] tail of a display call,
+ * iter is on its first argument if there is one */
+void display_parse_options(lui_msg_iter * iter, gint32 * priority,
+			   gint64 * deadline)
+{
+	guint32 deadline_ms = 0;
+
+	if (lui_msg_iter_get_arg_type(iter) != LUI_TYPE_INT32)
+		return;
+	lui_msg_iter_get_basic(iter, priority);
+
+	if (lui_msg_iter_next(iter) &&
+	    lui_msg_iter_get_arg_type(iter) == LUI_TYPE_UINT32)
+		lui_msg_iter_get_basic(iter, &deadline_ms);
+	if (deadline_ms)
+		*deadline = g_get_monotonic_time() +
+		    deadline_ms * G_TIME_SPAN_MILLISECOND;
+}
 
-	dbus_connection_setup_with_g_main(location_ui.dbus, NULL);
-	if (dbus_bus_request_name(location_ui.dbus, LUI_DBUS_NAME, 0, NULL) != 1) {
-		g_critical("Failed to register service '%s'. Already running?",
-			     LUI_DBUS_NAME);
-		return 1;
+lui_msg *location_ui_display_dialog(location_ui_t * location_ui,
+				    location_ui_dialog * dialog,
+				    lui_msg * msg)
+{
+	lui_msg_iter iter;
+	gint32 some_dbus_arg = 0, priority = dialog->priority;
+	gint64 deadline = 0;
+	gboolean queued;
+
+	/* display(i arg [, i priority [, u deadline_ms]]) */
+	if (lui_msg_iter_init(msg, &iter) &&
+	    lui_msg_iter_get_arg_type(&iter) == LUI_TYPE_INT32) {
+		lui_msg_iter_get_basic(&iter, &some_dbus_arg);
+		if (lui_msg_iter_next(&iter))
+			display_parse_options(&iter, &priority, &deadline);
 	}
 
-	if (!dbus_connection_register_object_path
-	    (location_ui.dbus, LUI_DBUS_PATH, &client_vtable, &location_ui)) {
-		g_critical("Failed to register object");
-		return 1;
-	}
+	queued = dialog_display(location_ui, dialog, some_dbus_arg, priority,
+				deadline);
+	dialog_trace(dialog, LUI_TRACE_DISPLAY, queued);
+	if (!queued)
+		return lui_msg_new_error_printf(msg, LUI_ERROR_IN_USE, "%d",
+						dialog->dialog_response_code);
 
-	for (i = 0; i < nelem(funcmap); i++) {
-		location_ui.dialogs =
-		    g_list_append(location_ui.dialogs, &funcmap[i]);
-		path = funcmap[i].path;
-		g_debug("Registering %s", path);
-		dbus_connection_register_object_path(location_ui.dbus, path,
-						     &find_cb_vtable,
-						     &location_ui);
+	dialog_set_requester(location_ui, dialog, msg);
+
+	/* The response follows the reply right away */
+	if (dialog->decided) {
+		lui_outbox_push(&location_ui->outbox,
+				lui_msg_new_method_return(msg));
+		dialog_emit_response(location_ui, dialog);
+		return NULL;
 	}
 
-	schedule_new_dialog(&location_ui);
-	gtk_main();
+	if (location_ui->current_dialog == NULL)
+		schedule_new_dialog(location_ui);
+	return lui_msg_new_method_return(msg);
+}
+
+/* Returns TRUE if the current dialog went away and a new one is due */
+gboolean dialog_close(location_ui_t * location_ui, location_ui_dialog * dialog)
+{
+	gboolean was_current;
+
+	was_current = location_ui->current_dialog == dialog;
+
+	if (dialog->fold_head)
+		fold_unlink(dialog);
+	else if (dialog->folded)
+		fold_release(location_ui, dialog);
+
+	if (dialog->waiter)
+		dialog_waiter_finish(dialog,
+				     lui_msg_new_error(dialog->waiter->msg,
+						       LUI_ERROR_CLOSED,
+						       "Dialog was closed"));
+
+	if (dialog->leader || dialog->followers) {
+		was_current = coalesce_detach(location_ui, dialog);
+	} else if (!dialog_is_static(dialog)) {
+		coalesce_forget(location_ui, dialog);
+	}
+
+	if (lui_pqueue_node_queued(&dialog->qnode))
+		lui_pqueue_remove(&location_ui->queue, &dialog->qnode);
+	dialog->state = STATE_IDLE;
+	dialog_stamp(dialog, LUI_STAMP_CLOSED);
+
+	if (dialog_is_static(dialog)) {
+		if (dialog->window && !dialog->pool_link.data)
+			dialog_release_window(location_ui, dialog);
+	} else if (dialog->window) {
+		location_ui->renderer->destroy(dialog->window);
+		dialog->window = NULL;
+	}
+
+	g_free(dialog->requester);
+	dialog->requester = NULL;
+
+	dialog->deadline = 0;
+
+	if (dialog_is_static(dialog)) {
+		dialog->dialog_active = 0;
+		dialog->some_dbus_arg = 0;
+		dialog->dialog_response_code = -1;
+		dialog_snapshot(location_ui, dialog);
+	} else {
+		lui_snapshot_clear(&location_ui->snapshot,
+				   snapshot_index(dialog));
+		if (dialog->req.msg)
+			lui_msg_unref(dialog->req.msg);
+		g_free(dialog->req.restored);
+		dialog_slab_free(&location_ui->slab, dialog);
+	}
+
+	if (was_current)
+		location_ui->current_dialog = NULL;
+
+	return was_current;
+}
+
+lui_msg *location_ui_close_dialog(location_ui_t * location_ui,
+				  location_ui_dialog * dialog,
+				  lui_msg * msg)
+{
+	lui_msg *new_msg;
+
+	new_msg = lui_msg_new_method_return(msg);
+	lui_msg_append_args(new_msg, LUI_TYPE_INT32,
+			    &dialog->dialog_response_code,
+			    LUI_TYPE_INVALID);
+
+	dialog_trace(dialog, LUI_TRACE_CLOSE, dialog->dialog_response_code);
+	if (dialog_close(location_ui, dialog))
+		schedule_new_dialog(location_ui);
+
+	return new_msg;
+}
+
+/*
+ * display_and_wait(i arg, u timeout_ms [, i priority [, u deadline_ms]])
+ *   -> i response
+ *
+ * Like display, and with the same optional arguments, but the reply is
+ * held back until the dialog is answered, so neither the response signal
+ * nor close is needed: the dialog is closed once the reply is out. It is
+ * also closed if timeout_ms (0 for none) passes first or the caller
+ * leaves the bus.
+ */
+lui_msg *location_ui_display_and_wait(location_ui_t * location_ui,
+				      location_ui_dialog * dialog,
+				      lui_msg * msg)
+{
+	lui_msg *reply;
+	lui_msg_iter iter;
+	dialog_waiter *waiter;
+	gint32 some_dbus_arg, priority = dialog->priority;
+	guint32 timeout_ms;
+	gint64 deadline = 0;
+	gboolean queued;
+	char *rule;
+
+	if (!lui_msg_get_args(msg, NULL, LUI_TYPE_INT32, &some_dbus_arg,
+			      LUI_TYPE_UINT32, &timeout_ms,
+			      LUI_TYPE_INVALID))
+		return lui_msg_new_error(msg, LUI_BUS_ERROR_INVALID_ARGS,
+					 "Expected iu");
+
+	lui_msg_iter_init(msg, &iter);
+	lui_msg_iter_next(&iter);
+	if (lui_msg_iter_next(&iter))
+		display_parse_options(&iter, &priority, &deadline);
+
+	/* An answer nobody closed yet belongs to whoever displayed it */
+	queued = dialog_display(location_ui, dialog, some_dbus_arg, priority,
+				deadline);
+	dialog_trace(dialog, LUI_TRACE_DISPLAY, queued);
+	if (!queued)
+		return lui_msg_new_error_printf(msg, LUI_ERROR_IN_USE, "%d",
+						dialog->dialog_response_code);
+
+	/* Answered from the cache, the flow is over right away */
+	if (dialog->dialog_active == 3) {
+		reply = lui_msg_new_method_return(msg);
+		lui_msg_append_args(reply, LUI_TYPE_INT32,
+				    &dialog->dialog_response_code,
+				    LUI_TYPE_INVALID);
+		dialog_trace(dialog, LUI_TRACE_CLOSE,
+			     dialog->dialog_response_code);
+		if (dialog_close(location_ui, dialog))
+			schedule_new_dialog(location_ui);
+		return reply;
+	}
+
+	waiter = g_slice_new0(dialog_waiter);
+	waiter->location_ui = location_ui;
+	waiter->dialog = dialog;
+	waiter->msg = lui_msg_ref(msg);
+	waiter->link.data = waiter;
+	g_queue_push_tail_link(&location_ui->waiters, &waiter->link);
+	dialog->waiter = waiter;
+
+	if (timeout_ms)
+		waiter->timeout_id =
+		    lui_loop_timeout_add(timeout_ms,
+					 (GSourceFunc) on_waiter_timeout,
+					 waiter);
+
+	/* The transport does not wait for the bus to confirm */
+	rule = waiter_match_rule(msg);
+	location_ui->transport->add_match(rule);
+	g_free(rule);
+
+	if (location_ui->current_dialog == NULL)
+		schedule_new_dialog(location_ui);
+	return NULL;
+}
+
+char *waiter_match_rule(lui_msg * msg)
+{
+	return g_strdup_printf("type='signal',sender='" LUI_BUS_NAME
+			       "',interface='" LUI_BUS_INTERFACE
+			       "',member='NameOwnerChanged',arg0='%s'",
+			       lui_msg_get_sender(msg));
+}
+
+/* Send reply, or drop the call if reply is NULL */
+void dialog_waiter_finish(location_ui_dialog * dialog, lui_msg * reply)
+{
+	dialog_waiter *waiter = dialog->waiter;
+	location_ui_t *location_ui = waiter->location_ui;
+	char *rule;
+
+	dialog->waiter = NULL;
+	g_queue_unlink(&location_ui->waiters, &waiter->link);
+	if (waiter->timeout_id)
+		lui_loop_remove(waiter->timeout_id);
+
+	rule = waiter_match_rule(waiter->msg);
+	location_ui->transport->remove_match(rule);
+	g_free(rule);
+
+	if (reply)
+		lui_outbox_push(&location_ui->outbox, reply);
+	lui_msg_unref(waiter->msg);
+	g_slice_free(dialog_waiter, waiter);
+}
+
+/* Close the dialogs whose waiting caller just got its answer */
+void dialog_close_waited(location_ui_t * location_ui)
+{
+	location_ui_dialog *dialog;
+	gboolean reschedule = FALSE;
+
+	while ((dialog = g_queue_pop_head(&location_ui->waited))) {
+		dialog_trace(dialog, LUI_TRACE_CLOSE,
+			     dialog->dialog_response_code);
+		reschedule |= dialog_close(location_ui, dialog);
+	}
+
+	if (reschedule && !location_ui->current_dialog)
+		schedule_new_dialog(location_ui);
+}
+
+gboolean on_waiter_timeout(dialog_waiter * waiter)
+{
+	location_ui_t *location_ui = waiter->location_ui;
+	location_ui_dialog *dialog = waiter->dialog;
+
+	waiter->timeout_id = 0;
+	dialog_waiter_finish(dialog, lui_msg_new_error(waiter->msg,
+						       LUI_ERROR_TIMEOUT,
+						       "No answer in time"));
+
+	if (dialog_close(location_ui, dialog))
+		schedule_new_dialog(location_ui);
+	return FALSE;
+}
+
+/* Close whatever a client that left the bus was still waiting for */
+lui_msg_result on_name_owner_changed(lui_msg * msg, gpointer data)
+{
+	location_ui_t *location_ui = data;
+	const char *name, *old_owner, *new_owner;
+	dialog_waiter *waiter;
+	location_ui_dialog *dialog;
+	gboolean reschedule = FALSE;
+	GList *l, *next;
+
+	if (!location_ui->waiters.length ||
+	    !lui_msg_is_signal(msg, LUI_BUS_INTERFACE,
+			       "NameOwnerChanged") ||
+	    !lui_msg_get_args(msg, NULL, LUI_TYPE_STRING, &name,
+			      LUI_TYPE_STRING, &old_owner,
+			      LUI_TYPE_STRING, &new_owner,
+			      LUI_TYPE_INVALID) || *new_owner)
+		return LUI_MSG_NOT_HANDLED;
+
+	for (l = location_ui->waiters.head; l; l = next) {
+		next = l->next;
+		waiter = l->data;
+		if (g_strcmp0(lui_msg_get_sender(waiter->msg), name))
+			continue;
+
+		dialog = waiter->dialog;
+		dialog_waiter_finish(dialog, NULL);
+		reschedule |= dialog_close(location_ui, dialog);
+	}
+
+	if (reschedule)
+		schedule_new_dialog(location_ui);
+
+	return LUI_MSG_NOT_HANDLED;
+}
+
+gboolean batch_get_path(lui_msg_iter * iter, const char **path)
+{
+	int type = lui_msg_iter_get_arg_type(iter);
+
+	if (type != LUI_TYPE_STRING && type != LUI_TYPE_OBJECT_PATH)
+		return FALSE;
+
+	lui_msg_iter_get_basic(iter, path);
+	return TRUE;
+}
+
+/*
+ * display_batch(a(si) dialogs) -> a(bi)
+ *
+ * Queues every (path, priority) entry and runs the scheduler once. Each
+ * result tells whether the entry was queued, or carries the response
+ * code of a dialog that was already in use. Nothing is queued unless
+ * every path resolves.
+ */
+lui_msg *location_ui_display_batch(location_ui_t * location_ui,
+				   lui_msg * msg)
+{
+	location_ui_dialog *dialogs[LUI_BATCH_MAX];
+	gint32 priorities[LUI_BATCH_MAX];
+	gboolean decided[LUI_BATCH_MAX];
+	lui_msg_iter iter, array, entry;
+	lui_msg *reply;
+	const char *path;
+	gboolean queued;
+	int i, n = 0, n_decided = 0;
+
+	if (!lui_msg_iter_init(msg, &iter) ||
+	    lui_msg_iter_get_arg_type(&iter) != LUI_TYPE_ARRAY ||
+	    lui_msg_iter_get_element_type(&iter) != LUI_TYPE_STRUCT)
+		return lui_msg_new_error(msg, LUI_BUS_ERROR_INVALID_ARGS,
+					 "Expected a(si)");
+
+	lui_msg_iter_recurse(&iter, &array);
+	while (lui_msg_iter_get_arg_type(&array) == LUI_TYPE_STRUCT) {
+		if (n == LUI_BATCH_MAX)
+			return lui_msg_new_error(msg,
+						 LUI_BUS_ERROR_LIMITS_EXCEEDED,
+						 "Too many dialogs");
+
+		lui_msg_iter_recurse(&array, &entry);
+		if (!batch_get_path(&entry, &path) ||
+		    !lui_msg_iter_next(&entry) ||
+		    lui_msg_iter_get_arg_type(&entry) != LUI_TYPE_INT32)
+			return lui_msg_new_error(msg,
+						 LUI_BUS_ERROR_INVALID_ARGS,
+						 "Expected a(si)");
+		lui_msg_iter_get_basic(&entry, &priorities[n]);
+
+		dialogs[n] = dispatch_lookup_dialog(location_ui, path);
+		if (!dialogs[n])
+			return lui_msg_new_error_printf(msg,
+							LUI_BUS_ERROR_FAILED,
+							"Bad object %s",
+							path);
+		n++;
+		lui_msg_iter_next(&array);
+	}
+
+	reply = lui_msg_new_method_return(msg);
+	lui_msg_iter_init_append(reply, &iter);
+	lui_msg_iter_open_container(&iter, LUI_TYPE_ARRAY, "(bi)", &array);
+
+	for (i = 0; i < n; i++) {
+		queued = dialog_display(location_ui, dialogs[i], 0,
+					priorities[i], 0);
+		dialog_trace(dialogs[i], LUI_TRACE_DISPLAY, queued);
+		if (queued)
+			dialog_set_requester(location_ui, dialogs[i], msg);
+		decided[i] = queued && dialogs[i]->decided;
+		n_decided += decided[i];
+		lui_msg_iter_open_container(&array, LUI_TYPE_STRUCT, NULL,
+					    &entry);
+		lui_msg_iter_append_basic(&entry, LUI_TYPE_BOOLEAN, &queued);
+		lui_msg_iter_append_basic(&entry, LUI_TYPE_INT32,
+					  &dialogs[i]->dialog_response_code);
+		lui_msg_iter_close_container(&array, &entry);
+	}
+
+	lui_msg_iter_close_container(&iter, &array);
+
+	/* Cached decisions are sent right after the reply */
+	if (n_decided) {
+		lui_outbox_push(&location_ui->outbox, reply);
+		for (i = 0; i < n; i++)
+			if (decided[i])
+				dialog_emit_response(location_ui, dialogs[i]);
+		reply = NULL;
+	}
+
+	if (location_ui->current_dialog == NULL)
+		schedule_new_dialog(location_ui);
+	return reply;
+}
+
+/*
+ * close_batch(as dialogs) -> ai
+ *
+ * Closes every dialog and returns their response codes in order, then
+ * runs the scheduler once. Nothing is closed unless every path resolves
+ * and appears only once.
+ */
+lui_msg *location_ui_close_batch(location_ui_t * location_ui,
+				 lui_msg * msg)
+{
+	location_ui_dialog *dialogs[LUI_BATCH_MAX];
+	gint32 codes[LUI_BATCH_MAX];
+	const gint32 *codes_ptr = codes;
+	lui_msg_iter iter, array;
+	lui_msg *reply;
+	const char *path;
+	gboolean reschedule = FALSE;
+	int i, j, n = 0;
+
+	if (!lui_msg_iter_init(msg, &iter) ||
+	    lui_msg_iter_get_arg_type(&iter) != LUI_TYPE_ARRAY)
+		return lui_msg_new_error(msg, LUI_BUS_ERROR_INVALID_ARGS,
+					 "Expected as");
+
+	lui_msg_iter_recurse(&iter, &array);
+	while (batch_get_path(&array, &path)) {
+		if (n == LUI_BATCH_MAX)
+			return lui_msg_new_error(msg,
+						 LUI_BUS_ERROR_LIMITS_EXCEEDED,
+						 "Too many dialogs");
+
+		dialogs[n] = dispatch_lookup_dialog(location_ui, path);
+		if (!dialogs[n])
+			return lui_msg_new_error_printf(msg,
+							LUI_BUS_ERROR_FAILED,
+							"Bad object %s",
+							path);
+
+		/* A closed client request is gone, it cannot be closed twice */
+		for (j = 0; j < n; j++)
+			if (dialogs[j] == dialogs[n])
+				return lui_msg_new_error_printf(msg,
+								LUI_BUS_ERROR_INVALID_ARGS,
+								"Duplicate object %s",
+								path);
+		n++;
+		lui_msg_iter_next(&array);
+	}
+
+	for (i = 0; i < n; i++) {
+		codes[i] = dialogs[i]->dialog_response_code;
+		dialog_trace(dialogs[i], LUI_TRACE_CLOSE, codes[i]);
+		reschedule |= dialog_close(location_ui, dialogs[i]);
+	}
+
+	if (reschedule)
+		schedule_new_dialog(location_ui);
+
+	reply = lui_msg_new_method_return(msg);
+	lui_msg_append_args(reply, LUI_TYPE_ARRAY, LUI_TYPE_INT32,
+			    &codes_ptr, n, LUI_TYPE_INVALID);
+	return reply;
+}
+
+void stats_append_counter(lui_msg_iter * array, const char *name,
+			  guint64 value)
+{
+	lui_msg_iter entry;
+
+	lui_msg_iter_open_container(array, LUI_TYPE_DICT_ENTRY, NULL, &entry);
+	lui_msg_iter_append_basic(&entry, LUI_TYPE_STRING, &name);
+	lui_msg_iter_append_basic(&entry, LUI_TYPE_UINT64, &value);
+	lui_msg_iter_close_container(array, &entry);
+}
+
+/*
+ * get_stats() -> a{st} counters, a(sstttat) histograms
+ *
+ * Histogram entries are (group, phase, count, sum_us, max_us, buckets)
+ * where the group is a dialog path or request type and bucket n counts
+ * durations of [2^n, 2^(n+1)) microseconds. Empty ones are left out.
+ */
+lui_msg *location_ui_get_stats(location_ui_t * location_ui,
+			       lui_msg * msg)
+{
+	lui_msg_iter iter, array, entry, sub;
+	lui_msg *reply;
+	lui_stats_group *group;
+	lui_histogram *h;
+	const guint64 *buckets;
+	const char *phase;
+	guint i, j;
+
+	reply = lui_msg_new_method_return(msg);
+	lui_msg_iter_init_append(reply, &iter);
+
+	lui_msg_iter_open_container(&iter, LUI_TYPE_ARRAY, "{st}", &array);
+	stats_append_counter(&array, "queue_depth",
+			     lui_pqueue_length(&location_ui->queue));
+	stats_append_counter(&array, "dialogs_in_use",
+			     location_ui->slab.in_use);
+	stats_append_counter(&array, "coalesced", location_ui->coalesced);
+	stats_append_counter(&array, "widget_pool_size",
+			     location_ui->widget_pool.length);
+	stats_append_counter(&array, "widget_pool_hits",
+			     location_ui->widget_pool_hits);
+	stats_append_counter(&array, "widget_pool_misses",
+			     location_ui->widget_pool_misses);
+	stats_append_counter(&array, "messages_sent",
+			     location_ui->outbox.sent);
+	stats_append_counter(&array, "message_batches",
+			     location_ui->outbox.batches);
+	stats_append_counter(&array, "outbox_depth_max",
+			     location_ui->outbox.depth_max);
+	stats_append_counter(&array, "outbox_latency_total_us",
+			     location_ui->outbox.latency_total);
+	stats_append_counter(&array, "outbox_latency_max_us",
+			     location_ui->outbox.latency_max);
+	stats_append_counter(&array, "expired", location_ui->expired);
+	stats_append_counter(&array, "notes_folded",
+			     location_ui->notes_folded);
+	stats_append_counter(&array, "snapshot_restored",
+			     location_ui->snapshot.restored);
+	stats_append_counter(&array, "decision_cache_hits",
+			     location_ui->decisions.hits);
+	stats_append_counter(&array, "decision_cache_misses",
+			     location_ui->decisions.misses);
+	lui_msg_iter_close_container(&iter, &array);
+
+	lui_msg_iter_open_container(&iter, LUI_TYPE_ARRAY, "(sstttat)",
+				    &array);
+	for (i = 0; i < location_ui->stats.groups->len; i++) {
+		group = g_ptr_array_index(location_ui->stats.groups, i);
+		for (j = 0; j < LUI_STAMPS; j++) {
+			h = &group->phases[j];
+			if (!h->count)
+				continue;
+
+			phase = lui_stats_phase_name(j);
+			buckets = h->buckets;
+			lui_msg_iter_open_container(&array,
+						    LUI_TYPE_STRUCT,
+						    NULL, &entry);
+			lui_msg_iter_append_basic(&entry,
+						  LUI_TYPE_STRING,
+						  &group->name);
+			lui_msg_iter_append_basic(&entry,
+						  LUI_TYPE_STRING,
+						  &phase);
+			lui_msg_iter_append_basic(&entry,
+						  LUI_TYPE_UINT64,
+						  &h->count);
+			lui_msg_iter_append_basic(&entry,
+						  LUI_TYPE_UINT64,
+						  &h->sum);
+			lui_msg_iter_append_basic(&entry,
+						  LUI_TYPE_UINT64,
+						  &h->max);
+			lui_msg_iter_open_container(&entry,
+						    LUI_TYPE_ARRAY, "t",
+						    &sub);
+			lui_msg_iter_append_fixed_array(&sub,
+							LUI_TYPE_UINT64,
+							&buckets,
+							LUI_HISTOGRAM_BUCKETS);
+			lui_msg_iter_close_container(&entry, &sub);
+			lui_msg_iter_close_container(&array, &entry);
+		}
+	}
+	lui_msg_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+/*
+ * dump_trace() -> s path
+ *
+ * Writes the event trace ring to a fixed file in the runtime directory,
+ * see tools/lui-trace for reading it back.
+ */
+lui_msg *location_ui_dump_trace(location_ui_t * location_ui,
+				lui_msg * msg)
+{
+	lui_msg *reply;
+	gchar *path = lui_trace_default_path();
+
+	if (lui_trace_dump(path)) {
+		reply = lui_msg_new_method_return(msg);
+		lui_msg_append_args(reply, LUI_TYPE_STRING, &path,
+				    LUI_TYPE_INVALID);
+	} else {
+		reply = lui_msg_new_error_printf(msg, LUI_BUS_ERROR_FAILED,
+						 "Cannot write %s", path);
+	}
+
+	g_free(path);
+	return reply;
+}
+
+/*
+ * get_memory() -> a{st}
+ *
+ * Resident set breakdown of the process in bytes, as the kernel reports
+ * it, plus what location-ui itself holds on to.
+ */
+lui_msg *location_ui_get_memory(location_ui_t * location_ui,
+				lui_msg * msg)
+{
+	lui_msg_iter iter, array;
+	lui_msg *reply;
+	lui_memory_usage usage;
+
+	if (!lui_memory_usage_get(&usage))
+		return lui_msg_new_error(msg, LUI_BUS_ERROR_FAILED,
+					 "Cannot read process status");
+
+	reply = lui_msg_new_method_return(msg);
+	lui_msg_iter_init_append(reply, &iter);
+	lui_msg_iter_open_container(&iter, LUI_TYPE_ARRAY, "{st}", &array);
+	stats_append_counter(&array, "rss", usage.rss);
+	stats_append_counter(&array, "rss_anon", usage.rss_anon);
+	stats_append_counter(&array, "rss_file", usage.rss_file);
+	stats_append_counter(&array, "rss_shmem", usage.rss_shmem);
+	stats_append_counter(&array, "rss_peak", usage.rss_peak);
+	stats_append_counter(&array, "data", usage.data);
+	stats_append_counter(&array, "ui_loaded", location_ui->ui_ready);
+	stats_append_counter(&array, "widget_pool_size",
+			     location_ui->widget_pool.length);
+	stats_append_counter(&array, "dialogs_in_use",
+			     location_ui->slab.in_use);
+	stats_append_counter(&array, "pressure_events",
+			     location_ui->pressure_events);
+	lui_msg_iter_close_container(&iter, &array);
+	return reply;
+}
+
+gboolean on_sigusr1(location_ui_t * location_ui)
+{
+	gchar *path = lui_trace_default_path();
+
+	lui_trace_dump(path);
+	g_free(path);
+	return TRUE;
+}
+
+void dialog_slab_init(dialog_slab * slab)
+{
+	int i;
+
+	slab->slots = g_new0(dialog_slot, LUI_DIALOG_SLOTS);
+	slab->free_list = NULL;
+	slab->in_use = 0;
+
+	for (i = LUI_DIALOG_SLOTS - 1; i >= 0; i--) {
+		slab->slots[i].next_free = slab->free_list;
+		slab->free_list = &slab->slots[i];
+	}
+}
+
+location_ui_dialog *dialog_slab_alloc(dialog_slab * slab)
+{
+	dialog_slot *slot = slab->free_list;
+
+	if (!slot)
+		return NULL;
+
+	slab->free_list = slot->next_free;
+
+	/* Generation 0 is never handed out, so no handle is 0 */
+	if (++slot->generation > G_MAXUINT / LUI_DIALOG_SLOTS - 1)
+		slot->generation = 1;
+
+	return dialog_slot_open(slab, slot);
+}
+
+/* Take the slot of a handle given out before a restart, if it is free */
+location_ui_dialog *dialog_slab_claim(dialog_slab * slab, guint id)
+{
+	dialog_slot *slot, **link;
+	guint generation = id / LUI_DIALOG_SLOTS;
+
+	if (!generation || generation > G_MAXUINT / LUI_DIALOG_SLOTS - 1)
+		return NULL;
+
+	slot = &slab->slots[id % LUI_DIALOG_SLOTS];
+	for (link = &slab->free_list; *link != slot; link = &(*link)->next_free)
+		if (!*link)
+			return NULL;
+
+	*link = slot->next_free;
+	slot->generation = generation;
+	return dialog_slot_open(slab, slot);
+}
+
+/* Hand out a slot already taken off the free list */
+location_ui_dialog *dialog_slot_open(dialog_slab * slab, dialog_slot * slot)
+{
+	location_ui_dialog *dialog;
+
+	slab->in_use++;
+	dialog = &slot->dialog;
+	memset(dialog, 0, sizeof(*dialog));
+	dialog->id = slot->generation * LUI_DIALOG_SLOTS +
+	    (slot - slab->slots);
+	dialog->path = slot->path;
+	dialog->dialog_response_code = -1;
+	g_snprintf(slot->path, sizeof(slot->path), LUI_DBUS_DIALOG_PATH "%u",
+		   dialog->id);
+
+	return dialog;
+}
+
+void dialog_slab_free(dialog_slab * slab, location_ui_dialog * dialog)
+{
+	dialog_slot *slot = (dialog_slot *) dialog;
+
+	g_assert(dialog_slab_lookup(slab, dialog->id) == dialog);
+
+	dialog->id = 0;
+	slot->next_free = slab->free_list;
+	slab->free_list = slot;
+	slab->in_use--;
+}
+
+location_ui_dialog *dialog_slab_lookup(dialog_slab * slab, guint id)
+{
+	dialog_slot *slot = &slab->slots[id % LUI_DIALOG_SLOTS];
+
+	return slot->dialog.id == id ? &slot->dialog : NULL;
+}
+
+guint coalesce_hash(gconstpointer key)
+{
+	const location_ui_dialog *dialog = key;
+	guint h = GPOINTER_TO_UINT(dialog->clireq);
+
+	h = h * 31 + dialog->req.accepted;
+	h = h * 31 + g_str_hash(dialog->req.requestor);
+	if (dialog->req.client)
+		h = h * 31 + g_str_hash(dialog->req.client);
+	return h;
+}
+
+gboolean coalesce_equal(gconstpointer a, gconstpointer b)
+{
+	const location_ui_dialog *da = a, *db = b;
+
+	return da->clireq == db->clireq &&
+	    da->req.accepted == db->req.accepted &&
+	    g_str_equal(da->req.requestor, db->req.requestor) &&
+	    !g_strcmp0(da->req.client, db->req.client);
+}
+
+/* Share the note of an identical open request, or offer ours to others */
+location_ui_dialog *dialog_coalesce(location_ui_t * location_ui,
+				    location_ui_dialog * dialog)
+{
+	location_ui_dialog *leader;
+
+	leader = coalesce_find(location_ui, dialog);
+	if (leader) {
+		dialog->leader = leader;
+		dialog->next_follower = leader->followers;
+		leader->followers = dialog;
+		location_ui->coalesced++;
+	} else {
+		g_hash_table_add(location_ui->coalesce, dialog);
+	}
+
+	return leader;
+}
+
+location_ui_dialog *coalesce_find(location_ui_t * location_ui,
+				  location_ui_dialog * dialog)
+{
+	location_ui_dialog *leader;
+
+	leader = g_hash_table_lookup(location_ui->coalesce, dialog);
+	if (!leader)
+		return NULL;
+
+	if (dialog->created - leader->created >
+	    LUI_COALESCE_WINDOW_MS * G_TIME_SPAN_MILLISECOND) {
+		g_hash_table_remove(location_ui->coalesce, leader);
+		return NULL;
+	}
+
+	return leader;
+}
+
+void coalesce_forget(location_ui_t * location_ui, location_ui_dialog * dialog)
+{
+	if (g_hash_table_lookup(location_ui->coalesce, dialog) == dialog)
+		g_hash_table_remove(location_ui->coalesce, dialog);
+}
+
+/* Whether any caller sharing leader's note still has it displayed */
+gboolean coalesce_wanted(location_ui_dialog * leader)
+{
+	location_ui_dialog *f;
+
+	if (leader->dialog_active)
+		return TRUE;
+	for (f = leader->followers; f; f = f->next_follower)
+		if (f->dialog_active)
+			return TRUE;
+	return FALSE;
+}
+
+/* Take a shared note nobody displays any more off the queue or screen,
+ * returns TRUE if it was the current dialog */
+gboolean coalesce_withdraw(location_ui_t * location_ui,
+			   location_ui_dialog * leader)
+{
+	gboolean was_current = location_ui->current_dialog == leader;
+
+	if (leader->fold_head)
+		fold_unlink(leader);
+	else if (leader->folded)
+		fold_release(location_ui, leader);
+
+	if (lui_pqueue_node_queued(&leader->qnode))
+		lui_pqueue_remove(&location_ui->queue, &leader->qnode);
+	leader->state = STATE_IDLE;
+	leader->deadline = 0;
+
+	/* Rebuilt on the next display, it may hold a whole stack */
+	if (leader->window) {
+		location_ui->renderer->destroy(leader->window);
+		leader->window = NULL;
+	}
+
+	if (was_current)
+		location_ui->current_dialog = NULL;
+
+	return was_current;
+}
+
+/* Unlink a closing dialog, handing a shared note on to a follower;
+ * returns TRUE if the note was current and went away with it */
+gboolean coalesce_detach(location_ui_t * location_ui,
+			 location_ui_dialog * dialog)
+{
+	location_ui_dialog **link, *leader, *heir, *f;
+
+	if ((leader = dialog->leader)) {
+		for (link = &leader->followers; *link;
+		     link = &(*link)->next_follower) {
+			if (*link == dialog) {
+				*link = dialog->next_follower;
+				break;
+			}
+		}
+		dialog->leader = NULL;
+		dialog->next_follower = NULL;
+		if (leader->state != STATE_IDLE && !coalesce_wanted(leader))
+			return coalesce_withdraw(location_ui, leader);
+		return FALSE;
+	}
+
+	heir = dialog->followers;
+	dialog->followers = NULL;
+	heir->leader = NULL;
+	heir->followers = heir->next_follower;
+	heir->next_follower = NULL;
+	heir->created = dialog->created;
+	heir->queued_at = dialog->queued_at;
+	heir->boost = dialog->boost;
+	memcpy(heir->stamps, dialog->stamps, sizeof(heir->stamps));
+	memset(dialog->stamps, 0, sizeof(dialog->stamps));
+	for (f = heir->followers; f; f = f->next_follower)
+		f->leader = heir;
+
+	if (g_hash_table_lookup(location_ui->coalesce, dialog) == dialog) {
+		g_hash_table_remove(location_ui->coalesce, dialog);
+		g_hash_table_add(location_ui->coalesce, heir);
+	}
+
+	/* Only the callers left decide whether the note stays up; if none
+	 * displayed it, it goes with us and the caller reschedules */
+	if (!coalesce_wanted(heir))
+		return location_ui->current_dialog == dialog;
+
+	heir->deadline = dialog->deadline;
+	heir->priority = dialog->priority;
+
+	if (dialog->window) {
+		heir->window = dialog->window;
+		dialog->window = NULL;
+		location_ui->renderer->set_owner(heir->window, heir);
+	}
+
+	if (location_ui->current_dialog == dialog) {
+		location_ui->current_dialog = heir;
+		heir->state = STATE_SHOWN;
+	} else if (dialog->state != STATE_IDLE) {
+		/* Queued, or folded into a stack we just left */
+		heir->state = STATE_QUEUED;
+		lui_pqueue_push(&location_ui->queue, &heir->qnode);
+		if (!location_ui->current_dialog)
+			schedule_new_dialog(location_ui);
+	}
+
+	return FALSE;
+}
+
+void dispatch_init(location_ui_t * location_ui)
+{
+	GQuark q;
+	int i;
+
+	location_ui->paths = g_hash_table_new(g_str_hash, g_str_equal);
+	location_ui->dialog_methods = g_hash_table_new(NULL, NULL);
+	location_ui->root_methods = g_hash_table_new(NULL, NULL);
+	location_ui->client_methods = g_hash_table_new(NULL, NULL);
+	location_ui->coalesce = g_hash_table_new(coalesce_hash, coalesce_equal);
+	location_ui->coalesced = 0;
+	lui_stats_init(&location_ui->stats);
+
+	for (i = 0; i < nelem(dc_map); i++) {
+		q = g_quark_from_static_string(dc_map[i].text);
+		g_hash_table_insert(location_ui->dialog_methods,
+				    GUINT_TO_POINTER(q), &dc_map[i]);
+	}
+
+	for (i = 0; i < nelem(root_map); i++) {
+		q = g_quark_from_static_string(root_map[i].text);
+		g_hash_table_insert(location_ui->root_methods,
+				    GUINT_TO_POINTER(q), &root_map[i]);
+	}
+
+	for (i = 0; i < nelem(clireq_table); i++) {
+		q = g_quark_from_static_string(clireq_table[i].text);
+		g_hash_table_insert(location_ui->client_methods,
+				    GUINT_TO_POINTER(q), &clireq_table[i]);
+		clireq_table[i].stats =
+		    lui_stats_group_add(&location_ui->stats,
+					clireq_table[i].text);
+	}
+}
+
+void dispatch_add_dialog(location_ui_t * location_ui,
+			 location_ui_dialog * dialog)
+{
+	g_hash_table_insert(location_ui->paths, dialog->path, dialog);
+	dialog->stats = lui_stats_group_add(&location_ui->stats, dialog->path +
+					    sizeof(LUI_DBUS_PATH));
+}
+
+location_ui_dialog *dispatch_lookup_dialog(location_ui_t * location_ui,
+					   const char *path)
+{
+	const char *suffix;
+	char *end;
+	guint64 id;
+
+	if (!path)
+		return NULL;
+
+	/* Dynamic dialogs are named after their handle */
+	if (g_str_has_prefix(path, LUI_DBUS_DIALOG_PATH)) {
+		suffix = path + sizeof(LUI_DBUS_DIALOG_PATH) - 1;
+		if (!g_ascii_isdigit(*suffix))
+			return NULL;
+
+		id = g_ascii_strtoull(suffix, &end, 10);
+		if (*end || !id || id > G_MAXUINT)
+			return NULL;
+
+		return dialog_slab_lookup(&location_ui->slab, id);
+	}
+
+	return g_hash_table_lookup(location_ui->paths, path);
+}
+
+gpointer dispatch_lookup_member(GHashTable * methods, lui_msg * msg)
+{
+	const char *member = lui_msg_get_member(msg);
+	GQuark q;
+
+	/* Members we never interned cannot be in the table */
+	if (!member || !(q = g_quark_try_string(member)))
+		return NULL;
+
+	return g_hash_table_lookup(methods, GUINT_TO_POINTER(q));
+}
+
+lui_msg_result on_client_request(lui_msg * msg, gpointer data)
+{
+	location_ui_t *location_ui = (location_ui_t *) data;
+	client_request_table *request;
+	root_method_map *method;
+	location_ui_dialog *dialog, *leader;
+	lui_msg *reply;
+	lui_msg_error error;
+
+	method = dispatch_lookup_member(location_ui->root_methods, msg);
+	if (method) {
+		/* Methods that sent their reply themselves return NULL */
+		reply = method->func(location_ui, msg);
+		if (reply)
+			lui_outbox_push(&location_ui->outbox, reply);
+		return LUI_MSG_HANDLED;
+	}
+
+	request = dispatch_lookup_member(location_ui->client_methods, msg);
+	if (!request)
+		return LUI_MSG_NOT_HANDLED;
+
+	dialog = dialog_slab_alloc(&location_ui->slab);
+	if (!dialog) {
+		reply = lui_msg_new_error(msg, LUI_BUS_ERROR_LIMITS_EXCEEDED,
+					  "Too many dialogs");
+		goto out;
+	}
+
+	lui_msg_error_init(&error);
+	if (!request->parse(msg, &dialog->req, &error)) {
+		dialog_slab_free(&location_ui->slab, dialog);
+		/* Not every parser failure says why */
+		if (lui_msg_error_is_set(&error)) {
+			reply = lui_msg_new_error(msg, error.name,
+						  error.message);
+			lui_msg_error_free(&error);
+		} else {
+			reply = lui_msg_new_error(msg,
+						  LUI_BUS_ERROR_INVALID_ARGS,
+						  "Invalid request");
+		}
+		goto out;
+	}
+
+	g_assert(!lui_msg_error_is_set(&error));
+	dialog->clireq = request;
+	dialog->kind = request->kind;
+	dialog->stats = request->stats;
+	dialog->req.msg = lui_msg_ref(msg);
+	dialog->created = g_get_monotonic_time();
+	dialog_set_requester(location_ui, dialog, msg);
+
+	/* Known answers are given on display, without sharing a note */
+	if (dialog->kind == LUI_DIALOG_PRIVACY_VERIFICATION &&
+	    lui_decisions_lookup(&location_ui->decisions,
+				 dialog->req.requestor, dialog->req.client,
+				 dialog->req.accepted,
+				 &dialog->dialog_response_code)) {
+		dialog->decided = TRUE;
+		leader = NULL;
+	} else {
+		leader = dialog_coalesce(location_ui, dialog);
+	}
+
+	dialog_snapshot(location_ui, dialog);
+	dialog_trace(dialog, LUI_TRACE_REQUEST, leader != NULL);
+	reply = lui_msg_new_method_return(msg);
+	lui_msg_append_args(reply, LUI_TYPE_OBJECT_PATH, &dialog->path,
+			    LUI_TYPE_INVALID);
+
+out:
+	lui_outbox_push(&location_ui->outbox, reply);
+	return LUI_MSG_HANDLED;
+}
+
+lui_msg_result find_dbus_cb(lui_msg * in_msg, gpointer data)
+{
+	location_ui_t *location_ui = (location_ui_t *) data;
+	const char *message_path;
+	display_close_map *method;
+	location_ui_dialog *dialog;
+	lui_msg *out_msg;
+
+	method = dispatch_lookup_member(location_ui->dialog_methods, in_msg);
+	if (!method)
+		return LUI_MSG_NOT_HANDLED;
+
+	message_path = lui_msg_get_path(in_msg);
+	dialog = dispatch_lookup_dialog(location_ui, message_path);
+	if (dialog)
+		out_msg = method->func(location_ui, dialog, in_msg);
+	else
+		out_msg = lui_msg_new_error(in_msg, LUI_BUS_ERROR_FAILED,
+					    "Bad object");
+
+	/* Deferred replies are sent later on */
+	if (out_msg)
+		lui_outbox_push(&location_ui->outbox, out_msg);
+	return LUI_MSG_HANDLED;
+}
+
+lui_msg_result on_object_request(lui_msg * msg, gpointer data)
+{
+	location_ui_t *location_ui = (location_ui_t *) data;
+	lui_msg_result ret;
+
+	lui_linger_busy(&location_ui->linger);
+
+	/* Everything below LUI_DBUS_PATH is served by this one handler */
+	if (!g_strcmp0(lui_msg_get_path(msg), LUI_DBUS_PATH))
+		ret = on_client_request(msg, data);
+	else
+		ret = find_dbus_cb(msg, data);
+
+	/* Still nothing to show, the idle period starts over */
+	if (location_ui->inactivity_timeout_id)
+		arm_inactivity_timeout(location_ui);
+
+	if (!location_ui->answered && ret == LUI_MSG_HANDLED) {
+		location_ui->answered = TRUE;
+		g_message("startup: first reply queued after %.1f ms",
+			  (g_get_monotonic_time() - startup_time) / 1000.0);
+	}
+
+	return ret;
+}
+
+/* Serves the bus until the exit timer fires, then stops the UI thread */
+gpointer bus_main(location_ui_t * location_ui)
+{
+	g_main_context_push_thread_default(lui_loop_get_context());
+
+	schedule_new_dialog(location_ui);
+	g_main_loop_run(location_ui->loop);
+	lui_outbox_flush(&location_ui->outbox);
+	lui_linger_save(&location_ui->linger);
+	lui_decisions_close(&location_ui->decisions);
+	lui_memory_unwatch();
+	lui_snapshot_close(&location_ui->snapshot);
+
+	lui_renderer_thread_quit();
+	return NULL;
+}
+
+int main(int argc, char **argv, char **envp)
+{
+	int i;
+	location_ui_t location_ui;
+	const lui_renderer *renderer;
+	GMainContext *bus_context;
+	GMainLoop *ui_loop;
+	GThread *bus_thread;
+	GSource *source;
+	GOptionContext *context;
+	GError *error = NULL;
+
+	startup_time = g_get_monotonic_time();
+
+	setlocale(LC_ALL, "");
+	bindtextdomain("osso-location-ui", "/usr/share/locale");
+	bind_textdomain_codeset("osso-location-ui", "UTF-8");
+	textdomain("osso-location-ui");
+
+	/* Leave the toolkit options in argv for the deferred renderer init */
+	context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(context, option_entries, NULL);
+	g_option_context_set_ignore_unknown_options(context, TRUE);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_critical("%s", error->message);
+		g_error_free(error);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	renderer = lui_renderer_find(renderer_name);
+	if (!renderer) {
+		g_critical("Unknown renderer '%s'", renderer_name);
+		return 1;
+	}
+
+	location_ui.transport = lui_transport_find(transport_name);
+	if (!location_ui.transport) {
+		g_critical("Unknown transport '%s'", transport_name);
+		return 1;
+	}
+	lui_transport_current = location_ui.transport;
+
+	if (!lui_renderer_null_script(MAX(think_ms, 0), MAX(think_jitter_ms, 0),
+				      answer_script)) {
+		g_critical("Bad answer script '%s'", answer_script);
+		return 1;
+	}
+
+	/* The dialog core and the bus get their own thread and context */
+	bus_context = g_main_context_new();
+	lui_loop_set_context(bus_context);
+	ui_loop = g_main_loop_new(NULL, FALSE);
+	location_ui.renderer = lui_renderer_thread_new(renderer, bus_context,
+						       ui_loop,
+						       on_dialog_response,
+						       &location_ui);
+	if (!location_ui.renderer) {
+		g_critical("Failed to set up the UI thread");
+		return 1;
+	}
+
+	location_ui.loop = g_main_loop_new(bus_context, FALSE);
+	location_ui.argc = &argc;
+	location_ui.argv = &argv;
+	location_ui.ui_ready = FALSE;
+	location_ui.preinit_id = 0;
+	location_ui.answered = FALSE;
+	lui_pqueue_init(&location_ui.queue, compare_dialog_priority);
+	location_ui.current_dialog = NULL;
+	location_ui.inactivity_timeout_id = 0;
+	location_ui.auto_answer_id = 0;
+	location_ui.aging_id = 0;
+	location_ui.expiry_id = 0;
+	location_ui.expiry_at = 0;
+	location_ui.expired = 0;
+	location_ui.pressure_events = 0;
+	location_ui.notes_folded = 0;
+	lui_linger_init(&location_ui.linger, MAX(linger_min, 0) * 1000,
+			MAX(linger_max, 0) * 1000);
+	lui_decisions_open(&location_ui.decisions, MAX(decision_ttl, 0));
+
+	for (i = 0; i < nelem(funcmap); i++)
+		funcmap[i].pool_link.data = NULL;
+	g_queue_init(&location_ui.widget_pool);
+	location_ui.widget_pool_hits = 0;
+	location_ui.widget_pool_misses = 0;
+	location_ui.prewarm_id = 0;
+
+	if (!location_ui.transport->connect(bus_context)) {
+		g_critical("Failed to init DBus");
+		return 1;
+	}
+	startup_phase("bus connected");
+
+	lui_outbox_init(&location_ui.outbox, location_ui.transport);
+
+	dispatch_init(&location_ui);
+	dialog_slab_init(&location_ui.slab);
+
+	for (i = 0; i < nelem(funcmap); i++) {
+		g_debug("Registering %s", funcmap[i].path);
+		dispatch_add_dialog(&location_ui, &funcmap[i]);
+	}
+
+	g_queue_init(&location_ui.waiters);
+	g_queue_init(&location_ui.waited);
+	location_ui.transport->add_filter(on_name_owner_changed, &location_ui);
+
+	/* Pick up where the last instance stopped, then take calls */
+	if (snapshot) {
+		lui_snapshot_open(&location_ui.snapshot,
+				  LUI_DIALOG_SLOTS + nelem(funcmap));
+		snapshot_replay(&location_ui);
+	} else {
+		memset(&location_ui.snapshot, 0, sizeof(location_ui.snapshot));
+	}
+
+	/* Objects go first so no call can arrive before they exist */
+	if (!location_ui.transport->register_object(LUI_DBUS_PATH,
+						    on_object_request,
+						    &location_ui)) {
+		g_critical("Failed to register object");
+		return 1;
+	}
+
+	if (!location_ui.transport->request_name(LUI_DBUS_NAME)) {
+		g_critical("Failed to register service '%s'. Already running?",
+			     LUI_DBUS_NAME);
+		return 1;
+	}
+	startup_phase("name claimed");
+
+	if (preinit)
+		location_ui.preinit_id = lui_loop_idle_add(G_PRIORITY_LOW,
+							   (GSourceFunc)
+							   on_ui_preinit,
+							   &location_ui);
+
+	source = g_unix_signal_source_new(SIGUSR1);
+	g_source_set_callback(source, (GSourceFunc) on_sigusr1, &location_ui,
+			      NULL);
+	g_source_attach(source, bus_context);
+	g_source_unref(source);
+
+	if (!lui_memory_watch(bus_context, on_memory_pressure, &location_ui))
+		g_debug("No memory pressure notifications available");
+
+	/* This thread is GTK's from here on */
+	bus_thread = g_thread_new("location-ui-bus", (GThreadFunc) bus_main,
+				  &location_ui);
+	g_main_loop_run(ui_loop);
+	g_thread_join(bus_thread);
 	return 0;
 }
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapfile.h"
+
+/* Returns the mapping, sized and zero filled if the file was not */
+gpointer lui_mapfile_open(const char *name, gsize size)
+{
+	gchar *path;
+	struct stat st;
+	gpointer map = NULL;
+	int fd;
+
+	path = g_build_filename(g_get_user_runtime_dir(), name, NULL);
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0 || fstat(fd, &st) < 0 ||
+	    ((gsize) st.st_size != size &&
+	     (ftruncate(fd, 0) < 0 || ftruncate(fd, size) < 0))) {
+		g_warning("%s: cannot open %s", G_STRFUNC, path);
+		goto out;
+	}
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		g_warning("%s: cannot map %s", G_STRFUNC, path);
+		map = NULL;
+	}
+
+out:
+	if (fd >= 0)
+		close(fd);
+	g_free(path);
+	return map;
+}
+
+void lui_mapfile_close(gpointer map, gsize size)
+{
+	if (map)
+		munmap(map, size);
+}
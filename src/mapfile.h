@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCATION_UI_MAPFILE_H__
+#define __LOCATION_UI_MAPFILE_H__
+
+#include <glib.h>
+
+/*
+ * Small state files in the runtime directory, mapped shared so what is
+ * written survives an exit or a crash without any explicit save.
+ */
+gpointer lui_mapfile_open(const char *name, gsize size);
+void lui_mapfile_close(gpointer map, gsize size);
+
+#endif
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_MALLOC_TRIM
+#include <malloc.h>
+#endif
+#include <sys/inotify.h>
+
+#include <glib-unix.h>
+
+#include "memory.h"
+
+#define PSI_MEMORY "/proc/pressure/memory"
+
+static struct {
+	GSource *source;
+	int fd;
+	lui_memory_func func;
+	gpointer data;
+	gint64 last;		/* monotonic time of the last report */
+	gchar *events;		/* cgroup memory.events, NULL with PSI */
+	guint64 events_seen;
+} watch = { NULL, -1 };
+
+static void memory_report(void)
+{
+	gint64 now = g_get_monotonic_time();
+
+	if (watch.last &&
+	    now - watch.last < LUI_MEMORY_HOLDOFF_MS * G_TIME_SPAN_MILLISECOND)
+		return;
+
+	watch.last = now;
+	watch.func(watch.data);
+}
+
+static gboolean on_psi(gint fd, GIOCondition cond, gpointer data)
+{
+	/* The trigger is gone, e.g. the pressure file was unmounted */
+	if (cond & G_IO_ERR) {
+		g_warning("%s: memory pressure trigger failed", G_STRFUNC);
+		watch.source = NULL;
+		return FALSE;
+	}
+
+	memory_report();
+	return TRUE;
+}
+
+static gboolean psi_open(void)
+{
+	watch.fd = open(PSI_MEMORY, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (watch.fd < 0)
+		return FALSE;
+
+	if (write(watch.fd, LUI_MEMORY_PSI_TRIGGER,
+		  sizeof(LUI_MEMORY_PSI_TRIGGER)) < 0) {
+		close(watch.fd);
+		watch.fd = -1;
+		return FALSE;
+	}
+
+	watch.source = g_unix_fd_source_new(watch.fd, G_IO_PRI | G_IO_ERR);
+	g_source_set_callback(watch.source, (GSourceFunc) on_psi, NULL, NULL);
+	return TRUE;
+}
+
+/* Times the cgroup ran into its high or max limit */
+static guint64 cgroup_events_read(void)
+{
+	gchar *buf = NULL, **lines;
+	guint64 n = 0;
+	int i;
+
+	if (!g_file_get_contents(watch.events, &buf, NULL, NULL))
+		return 0;
+
+	lines = g_strsplit(buf, "\n", -1);
+	for (i = 0; lines[i]; i++) {
+		if (g_str_has_prefix(lines[i], "high ") ||
+		    g_str_has_prefix(lines[i], "max "))
+			n += g_ascii_strtoull(strchr(lines[i], ' ') + 1,
+					      NULL, 10);
+	}
+
+	g_strfreev(lines);
+	g_free(buf);
+	return n;
+}
+
+static gboolean on_cgroup_event(gint fd, GIOCondition cond, gpointer data)
+{
+	char buf[sizeof(struct inotify_event) + 256];
+	guint64 n;
+
+	while (read(fd, buf, sizeof(buf)) > 0) ;
+
+	n = cgroup_events_read();
+	if (n > watch.events_seen)
+		memory_report();
+	watch.events_seen = n;
+	return TRUE;
+}
+
+/* cgroup v2 fallback, memory.events changes on every limit hit */
+static gboolean cgroup_open(void)
+{
+	gchar *buf = NULL, *line, *end;
+
+	if (!g_file_get_contents("/proc/self/cgroup", &buf, NULL, NULL))
+		return FALSE;
+
+	line = strstr(buf, "0::");
+	if (line) {
+		line += 3;
+		if ((end = strchr(line, '\n')))
+			*end = '\0';
+		watch.events = g_build_filename("/sys/fs/cgroup", line,
+						"memory.events", NULL);
+	}
+	g_free(buf);
+
+	if (!watch.events)
+		return FALSE;
+
+	watch.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch.fd < 0 ||
+	    inotify_add_watch(watch.fd, watch.events, IN_MODIFY) < 0) {
+		if (watch.fd >= 0)
+			close(watch.fd);
+		watch.fd = -1;
+		g_free(watch.events);
+		watch.events = NULL;
+		return FALSE;
+	}
+
+	watch.events_seen = cgroup_events_read();
+	watch.source = g_unix_fd_source_new(watch.fd, G_IO_IN);
+	g_source_set_callback(watch.source, (GSourceFunc) on_cgroup_event,
+			      NULL, NULL);
+	return TRUE;
+}
+
+/* Returns what is being watched, or NULL if the kernel offers neither */
+const char *lui_memory_watch(GMainContext * context, lui_memory_func func,
+			     gpointer data)
+{
+	const char *kind;
+
+	watch.func = func;
+	watch.data = data;
+
+	if (psi_open())
+		kind = "psi";
+	else if (cgroup_open())
+		kind = "cgroup";
+	else
+		return NULL;
+
+	g_source_attach(watch.source, context);
+	return kind;
+}
+
+void lui_memory_unwatch(void)
+{
+	if (watch.source) {
+		g_source_destroy(watch.source);
+		g_source_unref(watch.source);
+		watch.source = NULL;
+	}
+
+	if (watch.fd >= 0)
+		close(watch.fd);
+	watch.fd = -1;
+	g_free(watch.events);
+	watch.events = NULL;
+}
+
+/* Hand free heap pages back to the kernel */
+void lui_memory_trim(void)
+{
+#ifdef HAVE_MALLOC_TRIM
+	malloc_trim(0);
+#endif
+}
+
+gboolean lui_memory_usage_get(lui_memory_usage * usage)
+{
+	static const struct {
+		const char *key;
+		gsize offset;
+	} fields[] = {
+		{"VmRSS:", G_STRUCT_OFFSET(lui_memory_usage, rss)},
+		{"RssAnon:", G_STRUCT_OFFSET(lui_memory_usage, rss_anon)},
+		{"RssFile:", G_STRUCT_OFFSET(lui_memory_usage, rss_file)},
+		{"RssShmem:", G_STRUCT_OFFSET(lui_memory_usage, rss_shmem)},
+		{"VmHWM:", G_STRUCT_OFFSET(lui_memory_usage, rss_peak)},
+		{"VmData:", G_STRUCT_OFFSET(lui_memory_usage, data)},
+	};
+	char line[128];
+	guint64 kb;
+	FILE *f;
+	int i;
+
+	memset(usage, 0, sizeof(*usage));
+	if (!(f = fopen("/proc/self/status", "r")))
+		return FALSE;
+
+	while (fgets(line, sizeof(line), f)) {
+		for (i = 0; i < G_N_ELEMENTS(fields); i++) {
+			if (!g_str_has_prefix(line, fields[i].key))
+				continue;
+			kb = g_ascii_strtoull(line + strlen(fields[i].key),
+					      NULL, 10);
+			G_STRUCT_MEMBER(guint64, usage, fields[i].offset) =
+			    kb * 1024;
+		}
+	}
+
+	fclose(f);
+	return TRUE;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCATION_UI_MEMORY_H__
+#define __LOCATION_UI_MEMORY_H__
+
+#include <glib.h>
+
+/* Stall of 150 ms within 2 s, unprivileged triggers need a 2 s window */
+#define LUI_MEMORY_PSI_TRIGGER "some 150000 2000000"
+
+/* Pressure is reported at most this often */
+#define LUI_MEMORY_HOLDOFF_MS 5000
+
+typedef void (*lui_memory_func)(gpointer data);
+
+/* Resident set of this process, bytes */
+typedef struct lui_memory_usage {
+	guint64 rss;
+	guint64 rss_anon;
+	guint64 rss_file;
+	guint64 rss_shmem;
+	guint64 rss_peak;
+	guint64 data;		/* heap and private mappings */
+} lui_memory_usage;
+
+const char *lui_memory_watch(GMainContext *, lui_memory_func, gpointer);
+void lui_memory_unwatch(void);
+void lui_memory_trim(void);
+gboolean lui_memory_usage_get(lui_memory_usage *);
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <libintl.h>
+#include <locale.h>
+#include <string.h>
+
+#include "messages.h"
+
+/*
+ * Translated strings are looked up once per locale and kept interned.
+ * The locale is only compared on lui_messages_load(), which the renderer
+ * calls when it sets the locale up; lookups just read the tables.
+ * Templates with a single string argument are split around it at load
+ * time, so formatting only appends three pieces to a reused buffer.
+ */
+typedef struct lui_template {
+	const char *text;	/* translated, with %% and %s intact */
+	const char *prefix;	/* text before the argument, unescaped */
+	const char *suffix;	/* text after the argument, unescaped */
+} lui_template;
+
+static const struct {
+	const char *domain;
+	const char *msgid;
+} catalog[LUI_MSG_COUNT] = {
+	[LUI_MSG_VA_UNKNOWN] = {NULL, "loca_va_unknown"},
+	[LUI_MSG_NC_REQUEST_DEFAULT_REJECT] =
+	    {NULL, "loca_nc_request_default_reject"},
+	[LUI_MSG_NC_REQUEST_DEFAULT_ACCEPT] =
+	    {NULL, "loca_nc_request_default_accept"},
+	[LUI_MSG_NC_REQUEST_NO_DEFAULT] = {NULL, "loca_nc_request_no_default"},
+	[LUI_MSG_NI_REQ_SENT] = {NULL, "loca_ni_req_sent"},
+	[LUI_MSG_NI_ACCEPTED] = {NULL, "loca_ni_accepted"},
+	[LUI_MSG_NI_REJECTED] = {NULL, "loca_ni_rejected"},
+	[LUI_MSG_NI_ACCEPT_EXPIRED] = {NULL, "loca_ni_accept_expired"},
+	[LUI_MSG_NI_REJECT_EXPIRED] = {NULL, "loca_ni_reject_expired"},
+	[LUI_MSG_IN_DEFAULT_SUPL_USED] = {NULL, "loca_in_default_supl_used"},
+	[LUI_MSG_NC_BT_RECONNECT] = {NULL, "loca_nc_bt_reconnect"},
+	[LUI_MSG_TI_DISCLAIMER] = {NULL, "loca_ti_disclaimer"},
+	[LUI_MSG_BD_DISCLAIMER_OK] = {NULL, "loca_bd_disclaimer_ok"},
+	[LUI_MSG_BD_DISCLAIMER_REJECT] = {NULL, "loca_bd_disclaimer_reject"},
+	[LUI_MSG_FI_DISCLAIMER] = {NULL, "loca_fi_disclaimer"},
+	[LUI_MSG_NC_SWITCH_GPS_ON] = {NULL, "loca_nc_switch_gps_on"},
+	[LUI_MSG_NC_SWITCH_NETWORK_ON] = {NULL, "loca_nc_switch_network_on"},
+	[LUI_MSG_TI_SWITCH_GPS_NETWORK_ON] =
+	    {NULL, "loca_ti_switch_gps_network_on"},
+	[LUI_MSG_WDGT_BD_DONE] = {"hildon-libs", "wdgt_bd_done"},
+	[LUI_MSG_FI_GPS] = {NULL, "loca_fi_gps"},
+	[LUI_MSG_FI_NETWORK] = {NULL, "loca_fi_network"},
+	[LUI_MSG_NC_SWITCH_NETWORK_AND_GPS_ON] =
+	    {NULL, "loca_nc_switch_network_and_gps_on"},
+};
+
+static lui_template templates[LUI_MSG_COUNT];
+static gchar *loaded_locale;
+static GString *format_buf;
+
+/* Split "a%sb" into "a" and "b", FALSE if it takes anything but one %s */
+static gboolean template_parse(lui_template * t)
+{
+	GString *piece = g_string_new(NULL);
+	const char *p;
+	gboolean have_arg = FALSE;
+
+	for (p = t->text; *p; p++) {
+		if (*p != '%') {
+			g_string_append_c(piece, *p);
+			continue;
+		}
+
+		if (p[1] == '%') {
+			g_string_append_c(piece, '%');
+			p++;
+		} else if (!have_arg && (p[1] == 's' ||
+					 !strncmp(p + 1, "1$s", 3))) {
+			t->prefix = g_intern_string(piece->str);
+			g_string_truncate(piece, 0);
+			p += p[1] == 's' ? 1 : 3;
+			have_arg = TRUE;
+		} else {
+			g_string_free(piece, TRUE);
+			return FALSE;
+		}
+	}
+
+	if (have_arg)
+		t->suffix = g_intern_string(piece->str);
+	else
+		t->prefix = g_intern_string(piece->str);
+
+	g_string_free(piece, TRUE);
+	return TRUE;
+}
+
+static gboolean locale_changed(void)
+{
+	const char *current = setlocale(LC_MESSAGES, NULL);
+
+	return !loaded_locale || g_strcmp0(current, loaded_locale);
+}
+
+void lui_messages_load(void)
+{
+	lui_template *t;
+	int i;
+
+	if (!locale_changed())
+		return;
+
+	g_free(loaded_locale);
+	loaded_locale = g_strdup(setlocale(LC_MESSAGES, NULL));
+	g_debug("%s: building templates for %s", G_STRFUNC, loaded_locale);
+
+	if (!format_buf)
+		format_buf = g_string_sized_new(256);
+
+	for (i = 0; i < LUI_MSG_COUNT; i++) {
+		t = &templates[i];
+		t->text = g_intern_string(dgettext(catalog[i].domain,
+						   catalog[i].msgid));
+		t->prefix = t->suffix = NULL;
+		if (!template_parse(t))
+			t->prefix = t->suffix = NULL;
+	}
+}
+
+const char *lui_message(lui_msg_id id)
+{
+	if (G_UNLIKELY(!loaded_locale))
+		lui_messages_load();
+	return templates[id].text;
+}
+
+/* The result is only valid until the next call */
+const char *lui_message_format(lui_msg_id id, const char *arg)
+{
+	lui_template *t;
+	gchar *tmp;
+
+	if (G_UNLIKELY(!loaded_locale))
+		lui_messages_load();
+	t = &templates[id];
+	g_string_truncate(format_buf, 0);
+
+	if (t->prefix) {
+		g_string_append(format_buf, t->prefix);
+		if (t->suffix) {
+			g_string_append(format_buf, arg);
+			g_string_append(format_buf, t->suffix);
+		}
+	} else {
+		/* Template we could not split, let printf deal with it */
+		tmp = g_strdup_printf(t->text, arg);
+		g_string_append(format_buf, tmp);
+		g_free(tmp);
+	}
+
+	return format_buf->str;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCATION_UI_MESSAGES_H__
+#define __LOCATION_UI_MESSAGES_H__
+
+#include <glib.h>
+
+typedef enum {
+	LUI_MSG_VA_UNKNOWN,
+	LUI_MSG_NC_REQUEST_DEFAULT_REJECT,
+	LUI_MSG_NC_REQUEST_DEFAULT_ACCEPT,
+	LUI_MSG_NC_REQUEST_NO_DEFAULT,
+	LUI_MSG_NI_REQ_SENT,
+	LUI_MSG_NI_ACCEPTED,
+	LUI_MSG_NI_REJECTED,
+	LUI_MSG_NI_ACCEPT_EXPIRED,
+	LUI_MSG_NI_REJECT_EXPIRED,
+	LUI_MSG_IN_DEFAULT_SUPL_USED,
+	LUI_MSG_NC_BT_RECONNECT,
+	LUI_MSG_TI_DISCLAIMER,
+	LUI_MSG_BD_DISCLAIMER_OK,
+	LUI_MSG_BD_DISCLAIMER_REJECT,
+	LUI_MSG_FI_DISCLAIMER,
+	LUI_MSG_NC_SWITCH_GPS_ON,
+	LUI_MSG_NC_SWITCH_NETWORK_ON,
+	LUI_MSG_TI_SWITCH_GPS_NETWORK_ON,
+	LUI_MSG_WDGT_BD_DONE,
+	LUI_MSG_FI_GPS,
+	LUI_MSG_FI_NETWORK,
+	LUI_MSG_NC_SWITCH_NETWORK_AND_GPS_ON,
+	LUI_MSG_COUNT
+} lui_msg_id;
+
+/* Rebuild the tables if LC_MESSAGES changed since the last call */
+void lui_messages_load(void);
+const char *lui_message(lui_msg_id);
+const char *lui_message_format(lui_msg_id, const char *);
+
+#endif
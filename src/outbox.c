@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+
+#include "loop.h"
+#include "outbox.h"
+#include "trace.h"
+
+static gboolean on_outbox_idle(gpointer data)
+{
+	lui_outbox *outbox = data;
+
+	outbox->idle_id = 0;
+	lui_outbox_drain(outbox);
+	return G_SOURCE_REMOVE;
+}
+
+void lui_outbox_init(lui_outbox * outbox, const lui_transport * transport)
+{
+	memset(outbox, 0, sizeof(*outbox));
+	outbox->transport = transport;
+	outbox->pending = g_ptr_array_sized_new(16);
+}
+
+/* Takes ownership of msg */
+void lui_outbox_push(lui_outbox * outbox, lui_msg * msg)
+{
+	if (!outbox->pending->len)
+		outbox->oldest = g_get_monotonic_time();
+
+	g_ptr_array_add(outbox->pending, msg);
+	if (outbox->pending->len > outbox->depth_max)
+		outbox->depth_max = outbox->pending->len;
+
+	/* Run after the current dispatch round, but ahead of redraws */
+	if (!outbox->idle_id)
+		outbox->idle_id = lui_loop_idle_add(G_PRIORITY_HIGH_IDLE,
+						    on_outbox_idle, outbox);
+}
+
+/* Hand all queued messages over without waiting for the socket */
+void lui_outbox_drain(lui_outbox * outbox)
+{
+	lui_msg *msg;
+	gint64 latency;
+	guint i, n = outbox->pending->len;
+
+	if (!n)
+		return;
+
+	for (i = 0; i < n; i++) {
+		msg = g_ptr_array_index(outbox->pending, i);
+		if (!outbox->transport || !outbox->transport->send(msg))
+			g_warning("%s: failed to send message", G_STRFUNC);
+		lui_msg_unref(msg);
+	}
+	g_ptr_array_set_size(outbox->pending, 0);
+
+	latency = g_get_monotonic_time() - outbox->oldest;
+	outbox->sent += n;
+	outbox->batches++;
+	outbox->latency_total += latency;
+	if (latency > outbox->latency_max)
+		outbox->latency_max = latency;
+
+	lui_trace(LUI_TRACE_FLUSH, LUI_TRACE_NO_KIND, 0, n);
+}
+
+/* Blocking variant for shutdown, nothing may be left behind */
+void lui_outbox_flush(lui_outbox * outbox)
+{
+	if (outbox->idle_id) {
+		lui_loop_remove(outbox->idle_id);
+		outbox->idle_id = 0;
+	}
+
+	lui_outbox_drain(outbox);
+	if (outbox->transport)
+		outbox->transport->flush();
+
+	if (outbox->batches)
+		g_message("outbox: %" G_GUINT64_FORMAT " messages in %"
+			  G_GUINT64_FORMAT " batches, max depth %u, "
+			  "latency avg %" G_GINT64_FORMAT " us max %"
+			  G_GINT64_FORMAT " us", outbox->sent,
+			  outbox->batches, outbox->depth_max,
+			  outbox->latency_total / (gint64) outbox->batches,
+			  outbox->latency_max);
+}
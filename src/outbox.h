@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCATION_UI_OUTBOX_H__
+#define __LOCATION_UI_OUTBOX_H__
+
+#include <glib.h>
+
+#include "transport.h"
+
+/*
+ * Outgoing message pipeline. Replies and signals are queued and handed to
+ * the transport in one batch from an idle callback; it then writes them
+ * out whenever the socket is writable, so the main loop never blocks on
+ * a flush.
+ */
+typedef struct lui_outbox {
+	const lui_transport *transport;
+	GPtrArray *pending;
+	guint idle_id;
+	gint64 oldest;		/* enqueue time of pending->pdata[0] */
+
+	/* statistics */
+	guint64 sent;
+	guint64 batches;
+	guint depth_max;
+	gint64 latency_total;	/* enqueue to hand-off, microseconds */
+	gint64 latency_max;
+} lui_outbox;
+
+void lui_outbox_init(lui_outbox *, const lui_transport *);
+void lui_outbox_push(lui_outbox *, lui_msg *);
+void lui_outbox_drain(lui_outbox *);
+void lui_outbox_flush(lui_outbox *);
+
+#define lui_outbox_depth(o)	((o)->pending->len)
+
+#endif
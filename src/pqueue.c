@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "pqueue.h"
+
+#define PQ_INITIAL_ALLOC 16
+
+static gboolean node_before(lui_pqueue *pq, lui_pqueue_node *a,
+			    lui_pqueue_node *b)
+{
+	gint r = pq->cmp(a, b);
+
+	if (r)
+		return r < 0;
+
+	return a->seq < b->seq;
+}
+
+static void node_set(lui_pqueue *pq, guint pos, lui_pqueue_node *node)
+{
+	pq->heap[pos] = node;
+	node->index = pos + 1;
+}
+
+static void sift_up(lui_pqueue *pq, guint pos)
+{
+	lui_pqueue_node *node = pq->heap[pos];
+	guint parent;
+
+	while (pos > 0) {
+		parent = (pos - 1) / 2;
+		if (!node_before(pq, node, pq->heap[parent]))
+			break;
+		node_set(pq, pos, pq->heap[parent]);
+		pos = parent;
+	}
+
+	node_set(pq, pos, node);
+}
+
+static void sift_down(lui_pqueue *pq, guint pos)
+{
+	lui_pqueue_node *node = pq->heap[pos];
+	guint child;
+
+	while ((child = 2 * pos + 1) < pq->len) {
+		if (child + 1 < pq->len &&
+		    node_before(pq, pq->heap[child + 1], pq->heap[child]))
+			child++;
+		if (!node_before(pq, pq->heap[child], node))
+			break;
+		node_set(pq, pos, pq->heap[child]);
+		pos = child;
+	}
+
+	node_set(pq, pos, node);
+}
+
+void lui_pqueue_init(lui_pqueue * pq, lui_pqueue_cmp cmp)
+{
+	pq->heap = NULL;
+	pq->len = 0;
+	pq->alloc = 0;
+	pq->next_seq = 0;
+	pq->cmp = cmp;
+}
+
+void lui_pqueue_clear(lui_pqueue * pq)
+{
+	guint i;
+
+	for (i = 0; i < pq->len; i++)
+		pq->heap[i]->index = 0;
+
+	g_free(pq->heap);
+	pq->heap = NULL;
+	pq->len = 0;
+	pq->alloc = 0;
+}
+
+void lui_pqueue_push(lui_pqueue * pq, lui_pqueue_node * node)
+{
+	g_assert(!lui_pqueue_node_queued(node));
+
+	if (pq->len == pq->alloc) {
+		pq->alloc = pq->alloc ? pq->alloc * 2 : PQ_INITIAL_ALLOC;
+		pq->heap = g_renew(lui_pqueue_node *, pq->heap, pq->alloc);
+	}
+
+	node->seq = pq->next_seq++;
+	pq->heap[pq->len++] = node;
+	sift_up(pq, pq->len - 1);
+}
+
+lui_pqueue_node *lui_pqueue_peek(lui_pqueue * pq)
+{
+	return pq->len ? pq->heap[0] : NULL;
+}
+
+lui_pqueue_node *lui_pqueue_pop(lui_pqueue * pq)
+{
+	lui_pqueue_node *top = lui_pqueue_peek(pq);
+
+	if (top)
+		lui_pqueue_remove(pq, top);
+
+	return top;
+}
+
+void lui_pqueue_remove(lui_pqueue * pq, lui_pqueue_node * node)
+{
+	guint pos;
+	lui_pqueue_node *last;
+
+	g_assert(lui_pqueue_node_queued(node));
+	g_assert(pq->heap[node->index - 1] == node);
+
+	pos = node->index - 1;
+	node->index = 0;
+	last = pq->heap[--pq->len];
+
+	if (last == node)
+		return;
+
+	node_set(pq, pos, last);
+	if (pos > 0 && node_before(pq, last, pq->heap[(pos - 1) / 2]))
+		sift_up(pq, pos);
+	else
+		sift_down(pq, pos);
+}
+
+void lui_pqueue_update(lui_pqueue * pq, lui_pqueue_node * node)
+{
+	guint pos;
+
+	g_assert(lui_pqueue_node_queued(node));
+
+	pos = node->index - 1;
+	if (pos > 0 && node_before(pq, node, pq->heap[(pos - 1) / 2]))
+		sift_up(pq, pos);
+	else
+		sift_down(pq, pos);
+}
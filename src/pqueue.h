@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCATION_UI_PQUEUE_H__
+#define __LOCATION_UI_PQUEUE_H__
+
+#include <glib.h>
+
+/*
+ * Intrusive binary heap. The node is embedded in the queued record, so
+ * queueing never allocates per entry and a record can be removed or
+ * reprioritized in O(log n) through its own node. Entries that compare
+ * equal are returned in insertion order.
+ */
+typedef struct lui_pqueue_node {
+	guint index;		/* heap position + 1, 0 when not queued */
+	guint64 seq;		/* insertion order, used as tie-breaker */
+} lui_pqueue_node;
+
+/* Returns < 0 if a should be dequeued before b, > 0 if after, 0 if equal */
+typedef gint (*lui_pqueue_cmp)(const lui_pqueue_node *, const lui_pqueue_node *);
+
+typedef struct lui_pqueue {
+	lui_pqueue_node **heap;
+	guint len;
+	guint alloc;
+	guint64 next_seq;
+	lui_pqueue_cmp cmp;
+} lui_pqueue;
+
+void lui_pqueue_init(lui_pqueue *, lui_pqueue_cmp);
+void lui_pqueue_clear(lui_pqueue *);
+void lui_pqueue_push(lui_pqueue *, lui_pqueue_node *);
+lui_pqueue_node *lui_pqueue_peek(lui_pqueue *);
+lui_pqueue_node *lui_pqueue_pop(lui_pqueue *);
+void lui_pqueue_remove(lui_pqueue *, lui_pqueue_node *);
+void lui_pqueue_update(lui_pqueue *, lui_pqueue_node *);
+
+#define lui_pqueue_length(pq)		((pq)->len)
+#define lui_pqueue_node_queued(n)	((n)->index != 0)
+
+#endif
@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <gtk/gtk.h>
+
+#include <hildon/hildon.h>
+
+#include "messages.h"
+#include "renderer.h"
+
+/* lui_window is a GtkWidget here */
+#define WIDGET(w) ((GtkWidget *)(w))
+
+/* function declarations */
+static const char *requestor_text(const lui_dialog_args *);
+static const char *information_text(lui_dialog_kind,
+				    const lui_dialog_args *);
+static GtkWidget *create_privacy_verification_dialog(const lui_dialog_args *);
+static GtkWidget *create_privacy_information_dialog(const lui_dialog_args *);
+static GtkWidget *create_privacy_timeout_dialog(const lui_dialog_args *);
+static GtkWidget *create_privacy_expired_dialog(const lui_dialog_args *);
+static GtkWidget *create_default_supl_dialog(const lui_dialog_args *);
+static GtkWidget *create_bt_disconnected_dialog(void);
+static GtkWidget *create_disclaimer_dialog(void);
+static GtkWidget *create_enable_gps_dialog(void);
+static GtkWidget *create_enable_network_dialog(void);
+static GtkWidget *create_positioning_dialog(void);
+static GtkWidget *create_agnss_dialog(void);
+static void on_response(GtkWidget *, int, gpointer);
+static void renderer_init(int *, char ***);
+static lui_window *renderer_attach(GtkWidget *, gpointer);
+static lui_window *renderer_build(lui_dialog_kind, const lui_dialog_args *,
+				  gpointer);
+static lui_window *renderer_build_stack(guint, const lui_dialog_kind *,
+					const lui_dialog_args *, gpointer);
+static void renderer_set_owner(lui_window *, gpointer);
+static void renderer_present(lui_window *);
+static void renderer_hide(lui_window *);
+static void renderer_reset(lui_window *);
+static void renderer_answer(lui_window *);
+static void renderer_destroy(lui_window *);
+
+/* variables */
+static GtkWidget *(*const simple_factories[])(void) = {
+	[LUI_DIALOG_BT_DISCONNECTED] = create_bt_disconnected_dialog,
+	[LUI_DIALOG_DISCLAIMER] = create_disclaimer_dialog,
+	[LUI_DIALOG_ENABLE_GPS] = create_enable_gps_dialog,
+	[LUI_DIALOG_ENABLE_NETWORK] = create_enable_network_dialog,
+	[LUI_DIALOG_ENABLE_POSITIONING] = create_positioning_dialog,
+	[LUI_DIALOG_ENABLE_AGNSS] = create_agnss_dialog,
+};
+
+static GtkWidget *(*const request_factories[])(const lui_dialog_args *) = {
+	[LUI_DIALOG_PRIVACY_VERIFICATION] = create_privacy_verification_dialog,
+	[LUI_DIALOG_PRIVACY_INFORMATION] = create_privacy_information_dialog,
+	[LUI_DIALOG_PRIVACY_TIMEOUT] = create_privacy_timeout_dialog,
+	[LUI_DIALOG_PRIVACY_EXPIRED] = create_privacy_expired_dialog,
+	[LUI_DIALOG_DEFAULT_SUPL] = create_default_supl_dialog,
+};
+
+const lui_renderer lui_renderer_hildon = {
+	"hildon",
+	renderer_init,
+	renderer_build,
+	renderer_build_stack,
+	renderer_set_owner,
+	renderer_present,
+	renderer_hide,
+	renderer_reset,
+	renderer_answer,
+	renderer_destroy,
+};
+
+/* function implementations */
+const char *requestor_text(const lui_dialog_args * args)
+{
+	/* TODO: review */
+	if (*args->requestor)
+		return args->requestor;
+
+	return lui_message(LUI_MSG_VA_UNKNOWN);
+}
+
+GtkWidget *create_privacy_verification_dialog(const lui_dialog_args * args)
+{
+	lui_msg_id id;
+
+	switch (args->accepted) {
+	case 0:
+		id = LUI_MSG_NC_REQUEST_DEFAULT_REJECT;
+		break;
+	case 1:
+		id = LUI_MSG_NC_REQUEST_DEFAULT_ACCEPT;
+		break;
+	default:
+		id = LUI_MSG_NC_REQUEST_NO_DEFAULT;
+		break;
+	}
+
+	return hildon_note_new_confirmation(NULL,
+			lui_message_format(id, requestor_text(args)));
+}
+
+/* Text of an information note, valid until the next message is formatted */
+const char *information_text(lui_dialog_kind kind,
+			     const lui_dialog_args * args)
+{
+	lui_msg_id id;
+
+	switch (kind) {
+	case LUI_DIALOG_PRIVACY_INFORMATION:
+		return lui_message_format(LUI_MSG_NI_REQ_SENT,
+					  requestor_text(args));
+	case LUI_DIALOG_PRIVACY_TIMEOUT:
+		id = args->accepted ? LUI_MSG_NI_ACCEPTED : LUI_MSG_NI_REJECTED;
+		return lui_message_format(id, requestor_text(args));
+	case LUI_DIALOG_PRIVACY_EXPIRED:
+		if (args->accepted)
+			return lui_message(LUI_MSG_NI_ACCEPT_EXPIRED);
+		return lui_message(LUI_MSG_NI_REJECT_EXPIRED);
+	case LUI_DIALOG_DEFAULT_SUPL:
+		return lui_message_format(LUI_MSG_IN_DEFAULT_SUPL_USED,
+					  args->requestor);
+	default:
+		g_return_val_if_reached("");
+	}
+}
+
+GtkWidget *create_privacy_information_dialog(const lui_dialog_args * args)
+{
+	return hildon_note_new_information(NULL,
+			information_text(LUI_DIALOG_PRIVACY_INFORMATION, args));
+}
+
+GtkWidget *create_privacy_timeout_dialog(const lui_dialog_args * args)
+{
+	return hildon_note_new_information(NULL,
+			information_text(LUI_DIALOG_PRIVACY_TIMEOUT, args));
+}
+
+GtkWidget *create_privacy_expired_dialog(const lui_dialog_args * args)
+{
+	return hildon_note_new_information(NULL,
+			information_text(LUI_DIALOG_PRIVACY_EXPIRED, args));
+}
+
+GtkWidget *create_default_supl_dialog(const lui_dialog_args * args)
+{
+	return hildon_note_new_information(NULL,
+			information_text(LUI_DIALOG_DEFAULT_SUPL, args));
+}
+
+GtkWidget *create_bt_disconnected_dialog(void)
+{
+	const char *t = lui_message(LUI_MSG_NC_BT_RECONNECT);
+	return hildon_note_new_confirmation(NULL, t);
+}
+
+GtkWidget *create_disclaimer_dialog(void)
+{
+	const char *disclaimer_text, *disclaimer_ok, *disclaimer_reject;
+	const char *fi_disclaimer_text;
+	GtkWidget *dialog, *label, *pan;
+
+	disclaimer_text = lui_message(LUI_MSG_TI_DISCLAIMER);
+	disclaimer_ok = lui_message(LUI_MSG_BD_DISCLAIMER_OK);
+	disclaimer_reject = lui_message(LUI_MSG_BD_DISCLAIMER_REJECT);
+
+	/* TODO: What is 42 below? */
+	dialog = gtk_dialog_new_with_buttons(disclaimer_text, NULL,
+					     GTK_DIALOG_NO_SEPARATOR,
+					     disclaimer_ok, GTK_RESPONSE_OK,
+					     disclaimer_reject, 42, NULL);
+
+	fi_disclaimer_text = lui_message(LUI_MSG_FI_DISCLAIMER);
+	label = gtk_label_new(fi_disclaimer_text);
+	gtk_label_set_line_wrap(GTK_LABEL(label), TRUE);
+	gtk_widget_set_name(label, "osso-SmallFont");
+
+	pan = hildon_pannable_area_new();
+	hildon_pannable_area_add_with_viewport(HILDON_PANNABLE_AREA(pan), label);
+	g_object_set(G_OBJECT(pan), "hscrollbar-policy", 2, NULL);
+	gtk_widget_set_size_request(pan, -1, 350);
+
+	gtk_box_pack_start(GTK_BOX(GTK_DIALOG(dialog)->vbox), pan, FALSE, TRUE, 0);
+	/* The window itself is shown by gtk_window_present() */
+	gtk_widget_show_all(pan);
+	return dialog;
+}
+
+GtkWidget *create_enable_gps_dialog(void)
+{
+	const char *t = lui_message(LUI_MSG_NC_SWITCH_GPS_ON);
+	return hildon_note_new_confirmation(NULL, t);
+}
+
+GtkWidget *create_enable_network_dialog(void)
+{
+	const char *t = lui_message(LUI_MSG_NC_SWITCH_NETWORK_ON);
+	return hildon_note_new_confirmation(NULL, t);
+}
+
+GtkWidget *create_positioning_dialog(void)
+{
+	const char *gps_on_text, *done_text, *gps_text, *net_text;
+	GtkWidget *dialog, *cb_gps, *cb_net;
+
+	gps_on_text = lui_message(LUI_MSG_TI_SWITCH_GPS_NETWORK_ON);
+	done_text = lui_message(LUI_MSG_WDGT_BD_DONE);
+
+	dialog = gtk_dialog_new_with_buttons(gps_on_text, NULL,
+					     GTK_DIALOG_NO_SEPARATOR, done_text,
+					     GTK_RESPONSE_OK, NULL);
+
+	cb_gps = hildon_check_button_new(HILDON_SIZE_FINGER_HEIGHT);
+	gps_text = lui_message(LUI_MSG_FI_GPS);
+	gtk_button_set_label(GTK_BUTTON(cb_gps), gps_text);
+	gtk_box_pack_start(GTK_BOX(GTK_DIALOG(dialog)->vbox), cb_gps, FALSE, FALSE, 0);
+	gtk_widget_show(cb_gps);
+	g_object_set_data(G_OBJECT(dialog), "gps-cb", cb_gps);
+
+	cb_net = hildon_check_button_new(HILDON_SIZE_FINGER_HEIGHT);
+	net_text = lui_message(LUI_MSG_FI_NETWORK);
+	gtk_button_set_label(GTK_BUTTON(cb_net), net_text);
+	gtk_box_pack_start(GTK_BOX(GTK_DIALOG(dialog)->vbox), cb_net, FALSE, FALSE, 0);
+	gtk_widget_show(cb_net);
+	g_object_set_data(G_OBJECT(dialog), "net-cb", cb_net);
+
+	return dialog;
+}
+
+GtkWidget *create_agnss_dialog(void)
+{
+	const char *t = lui_message(LUI_MSG_NC_SWITCH_NETWORK_AND_GPS_ON);
+	return hildon_note_new_confirmation(NULL, t);
+}
+
+void on_response(GtkWidget * dialog, int gtk_response, gpointer data)
+{
+	GTypeInstance *gps_cb_data, *net_cb_data;
+	int gps_active_status, net_active_status, resp_code;
+	HildonCheckButton *gps_cb_button, *net_cb_button;
+	gboolean gps_button_active, net_button_active;
+	gpointer owner;
+
+	/* A window torn down by renderer_destroy() has no owner anymore */
+	owner = g_object_get_data(G_OBJECT(dialog), "dialog-data");
+	if (!owner)
+		return;
+
+	resp_code = 0;
+	gps_cb_data = g_object_get_data(G_OBJECT(dialog), "gps-cb");
+	net_cb_data = g_object_get_data(G_OBJECT(dialog), "net-cb");
+
+	if (gps_cb_data && net_cb_data) {
+		gps_cb_button = HILDON_CHECK_BUTTON(gps_cb_data);
+		net_cb_button = HILDON_CHECK_BUTTON(net_cb_data);
+		gps_button_active = hildon_check_button_get_active(gps_cb_button);
+		net_button_active = hildon_check_button_get_active(net_cb_button);
+
+		gps_active_status = resp_code;
+
+		if (gps_button_active)
+			gps_active_status |= 1u;
+
+		if (net_button_active)
+			net_active_status = 2;
+		else
+			net_active_status = 0;
+
+		resp_code = gps_active_status | net_active_status;
+	} else if (gtk_response == GTK_RESPONSE_OK) {
+		/* ok/accepted */
+		resp_code = 0;
+	} else if (gtk_response == GTK_RESPONSE_CANCEL) {
+		resp_code = 1;
+	} else {
+		/* unknown/invalid ? */
+		/* TODO: At least gets triggered when /disclaimer is Rejected */
+		resp_code = -1;
+	}
+
+	lui_renderer_respond(owner, resp_code);
+}
+
+/* GTK and the theme are only loaded once something is to be shown */
+void renderer_init(int *argc, char ***argv)
+{
+	gtk_init(argc, argv);
+	lui_messages_load();
+}
+
+lui_window *renderer_build(lui_dialog_kind kind,
+			   const lui_dialog_args * args, gpointer owner)
+{
+	GtkWidget *widget;
+
+	if (kind < G_N_ELEMENTS(simple_factories) && simple_factories[kind])
+		widget = simple_factories[kind]();
+	else
+		widget = request_factories[kind](args);
+
+	return renderer_attach(widget, owner);
+}
+
+/* The notes one below the other in a pannable area, with a single button */
+lui_window *renderer_build_stack(guint n, const lui_dialog_kind * kinds,
+				 const lui_dialog_args * args, gpointer owner)
+{
+	GtkWidget *dialog, *vbox, *label, *pan;
+	guint i;
+
+	dialog = gtk_dialog_new_with_buttons(NULL, NULL,
+					     GTK_DIALOG_NO_SEPARATOR,
+					     lui_message(LUI_MSG_WDGT_BD_DONE),
+					     GTK_RESPONSE_OK, NULL);
+
+	vbox = gtk_vbox_new(FALSE, HILDON_MARGIN_DOUBLE);
+	for (i = 0; i < n; i++) {
+		label = gtk_label_new(information_text(kinds[i], &args[i]));
+		gtk_label_set_line_wrap(GTK_LABEL(label), TRUE);
+		gtk_misc_set_alignment(GTK_MISC(label), 0.0, 0.5);
+		gtk_box_pack_start(GTK_BOX(vbox), label, FALSE, FALSE, 0);
+	}
+
+	pan = hildon_pannable_area_new();
+	hildon_pannable_area_add_with_viewport(HILDON_PANNABLE_AREA(pan), vbox);
+	g_object_set(G_OBJECT(pan), "hscrollbar-policy", GTK_POLICY_NEVER,
+		     NULL);
+	gtk_widget_set_size_request(pan, -1, 350);
+
+	gtk_box_pack_start(GTK_BOX(GTK_DIALOG(dialog)->vbox), pan, TRUE, TRUE, 0);
+	gtk_widget_show_all(pan);
+	return renderer_attach(dialog, owner);
+}
+
+lui_window *renderer_attach(GtkWidget * widget, gpointer owner)
+{
+	g_object_set_data(G_OBJECT(widget), "dialog-data", owner);
+	g_signal_connect(widget, "response", G_CALLBACK(on_response), NULL);
+	return (lui_window *) widget;
+}
+
+void renderer_set_owner(lui_window * window, gpointer owner)
+{
+	g_object_set_data(G_OBJECT(window), "dialog-data", owner);
+}
+
+void renderer_present(lui_window * window)
+{
+	gtk_window_present(GTK_WINDOW(window));
+}
+
+void renderer_hide(lui_window * window)
+{
+	gtk_widget_hide(WIDGET(window));
+}
+
+void renderer_reset(lui_window * window)
+{
+	GtkWidget *cb;
+
+	if ((cb = g_object_get_data(G_OBJECT(window), "gps-cb")))
+		hildon_check_button_set_active(HILDON_CHECK_BUTTON(cb), FALSE);
+	if ((cb = g_object_get_data(G_OBJECT(window), "net-cb")))
+		hildon_check_button_set_active(HILDON_CHECK_BUTTON(cb), FALSE);
+}
+
+void renderer_answer(lui_window * window)
+{
+	gtk_dialog_response(GTK_DIALOG(window), GTK_RESPONSE_OK);
+}
+
+/* Information notes too, each one belongs to a single client request */
+void renderer_destroy(lui_window * window)
+{
+	g_object_set_data(G_OBJECT(window), "dialog-data", NULL);
+	gtk_widget_destroy(WIDGET(window));
+}
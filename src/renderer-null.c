@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+
+#include "renderer.h"
+
+/*
+ * Headless renderer. Nothing is drawn; every presented dialog is answered
+ * after a think time, with response codes taken in turn from a script.
+ */
+struct lui_window {
+	lui_dialog_kind kind;
+	gpointer owner;
+	guint think_id;
+};
+
+/* function declarations */
+static gboolean on_think(lui_window *);
+static void null_init(int *, char ***);
+static lui_window *null_build(lui_dialog_kind, const lui_dialog_args *,
+			      gpointer);
+static lui_window *null_build_stack(guint, const lui_dialog_kind *,
+				    const lui_dialog_args *, gpointer);
+static void null_set_owner(lui_window *, gpointer);
+static void null_present(lui_window *);
+static void null_hide(lui_window *);
+static void null_reset(lui_window *);
+static void null_answer(lui_window *);
+static void null_destroy(lui_window *);
+
+/* variables */
+static guint think_ms;
+static guint jitter_ms;
+static GArray *codes;		/* response script, 0 when empty */
+static guint next_code;
+
+const lui_renderer lui_renderer_null = {
+	"null",
+	null_init,
+	null_build,
+	null_build_stack,
+	null_set_owner,
+	null_present,
+	null_hide,
+	null_reset,
+	null_answer,
+	null_destroy,
+};
+
+/* function implementations */
+
+/* codes is a comma separated list of response codes, used round robin */
+gboolean lui_renderer_null_script(guint think, guint jitter,
+				  const char *script)
+{
+	gchar **items, *end;
+	gint code;
+	int i;
+
+	think_ms = think;
+	jitter_ms = jitter;
+
+	if (codes)
+		g_array_set_size(codes, 0);
+	else
+		codes = g_array_new(FALSE, FALSE, sizeof(gint));
+	next_code = 0;
+
+	if (!script)
+		return TRUE;
+
+	items = g_strsplit(script, ",", -1);
+	for (i = 0; items[i]; i++) {
+		code = strtol(items[i], &end, 10);
+		if (end == items[i] || *end) {
+			g_strfreev(items);
+			return FALSE;
+		}
+		g_array_append_val(codes, code);
+	}
+	g_strfreev(items);
+
+	return TRUE;
+}
+
+gboolean on_think(lui_window * window)
+{
+	gint code = 0;
+
+	window->think_id = 0;
+	if (codes && codes->len)
+		code = g_array_index(codes, gint, next_code++ % codes->len);
+
+	/* May hide or destroy the window, do not touch it afterwards */
+	lui_renderer_respond(window->owner, code);
+	return FALSE;
+}
+
+void null_init(int *argc, char ***argv)
+{
+}
+
+lui_window *null_build(lui_dialog_kind kind, const lui_dialog_args * args,
+		       gpointer owner)
+{
+	lui_window *window = g_slice_new0(lui_window);
+
+	window->kind = kind;
+	window->owner = owner;
+	return window;
+}
+
+/* A stack takes one think time like any other window */
+lui_window *null_build_stack(guint n, const lui_dialog_kind * kinds,
+			     const lui_dialog_args * args, gpointer owner)
+{
+	return null_build(kinds[0], &args[0], owner);
+}
+
+void null_set_owner(lui_window * window, gpointer owner)
+{
+	window->owner = owner;
+}
+
+void null_present(lui_window * window)
+{
+	guint delay = think_ms;
+
+	if (window->think_id)
+		return;
+
+	if (jitter_ms)
+		delay += g_random_int_range(0, jitter_ms + 1);
+
+	window->think_id = g_timeout_add(delay, (GSourceFunc) on_think,
+					 window);
+}
+
+void null_hide(lui_window * window)
+{
+	if (window->think_id) {
+		g_source_remove(window->think_id);
+		window->think_id = 0;
+	}
+}
+
+void null_reset(lui_window * window)
+{
+}
+
+void null_answer(lui_window * window)
+{
+	null_hide(window);
+	lui_renderer_respond(window->owner, 0);
+}
+
+void null_destroy(lui_window * window)
+{
+	null_hide(window);
+	g_slice_free(lui_window, window);
+}
@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+
+#include "renderer.h"
+#include "spsc.h"
+
+/*
+ * Runs another renderer on the GTK thread on behalf of the dialog core,
+ * which lives on the bus thread. Calls are turned into commands on one
+ * queue, answers come back on another. Only the bus thread ever waits,
+ * for room among the commands; the GTK thread keeps events it has no
+ * room for until there is, so it always gets back to the commands and
+ * the two can not wait for each other. A proxy window is created on the
+ * bus thread and only freed there, once the GTK thread confirms the
+ * real window is gone.
+ */
+#define THREAD_QUEUE_SIZE 1024
+
+typedef struct proxy_window {
+	lui_window *real;	/* GTK thread */
+	guint ui_serial;	/* GTK thread, presentation being shown */
+	gpointer owner;		/* bus thread from here on */
+	guint serial;		/* bumped on every present */
+	gboolean shown;
+	gboolean dead;
+} proxy_window;
+
+typedef enum {
+	CMD_INIT,
+	CMD_BUILD,
+	CMD_BUILD_STACK,
+	CMD_PRESENT,
+	CMD_HIDE,
+	CMD_RESET,
+	CMD_ANSWER,
+	CMD_DESTROY,
+	CMD_QUIT,
+} proxy_cmd_type;
+
+typedef struct proxy_cmd {
+	proxy_cmd_type type;
+	proxy_window *window;
+	lui_dialog_kind kind;
+	int accepted;
+	const gchar *requestor;	/* interned, the request may be gone by then */
+	guint n;
+	lui_dialog_kind *kinds;	/* CMD_BUILD_STACK, copied */
+	lui_dialog_args *stack;
+	guint serial;
+} proxy_cmd;
+
+typedef enum {
+	EVENT_RESPONSE,
+	EVENT_DESTROYED,
+} proxy_event_type;
+
+typedef struct proxy_event {
+	proxy_event_type type;
+	proxy_window *window;
+	int code;
+	guint serial;
+} proxy_event;
+
+/* function declarations */
+static void on_command(gpointer, gpointer);
+static void on_event(gpointer, gpointer);
+static void on_ui_response(gpointer, int, gpointer);
+static void proxy_push(proxy_cmd_type, proxy_window *);
+static void proxy_init(int *, char ***);
+static lui_window *proxy_build(lui_dialog_kind, const lui_dialog_args *,
+			       gpointer);
+static lui_window *proxy_build_stack(guint, const lui_dialog_kind *,
+				     const lui_dialog_args *, gpointer);
+static void proxy_set_owner(lui_window *, gpointer);
+static void proxy_present(lui_window *);
+static void proxy_hide(lui_window *);
+static void proxy_reset(lui_window *);
+static void proxy_answer(lui_window *);
+static void proxy_destroy(lui_window *);
+
+/* variables */
+static const lui_renderer *ui;
+static GMainLoop *ui_loop;
+static lui_spsc commands;	/* bus thread -> GTK thread */
+static lui_spsc events;		/* GTK thread -> bus thread */
+static lui_response_func core_func;
+static gpointer core_data;
+static int *init_argc;
+static char ***init_argv;
+static guint destroys_pending;	/* bus thread */
+static void (*drained_func)(gpointer);
+static gpointer drained_data;
+
+static const lui_renderer proxy = {
+	"thread",
+	proxy_init,
+	proxy_build,
+	proxy_build_stack,
+	proxy_set_owner,
+	proxy_present,
+	proxy_hide,
+	proxy_reset,
+	proxy_answer,
+	proxy_destroy,
+};
+
+/* function implementations */
+
+/*
+ * Wrap real, which from now on is only called from the default context.
+ * Answers are handed to func from core, the bus thread's context.
+ */
+const lui_renderer *lui_renderer_thread_new(const lui_renderer * real,
+					    GMainContext * core,
+					    GMainLoop * loop,
+					    lui_response_func func,
+					    gpointer data)
+{
+	if (!lui_spsc_init(&commands, THREAD_QUEUE_SIZE, sizeof(proxy_cmd)) ||
+	    !lui_spsc_init(&events, THREAD_QUEUE_SIZE, sizeof(proxy_event)))
+		return NULL;
+
+	ui = real;
+	ui_loop = loop;
+	core_func = func;
+	core_data = data;
+
+	lui_spsc_attach(&commands, NULL, on_command, NULL);
+	lui_spsc_attach(&events, core, on_event, NULL);
+	lui_renderer_connect(on_ui_response, NULL);
+	return &proxy;
+}
+
+/* Stop the GTK thread's loop after everything queued so far */
+void lui_renderer_thread_quit(void)
+{
+	proxy_push(CMD_QUIT, NULL);
+}
+
+/*
+ * Bus thread, call func once the GTK thread has destroyed every window
+ * asked for so far, right away if there are none. Only the last caller
+ * waiting is remembered.
+ */
+void lui_renderer_thread_drained(void (*func)(gpointer), gpointer data)
+{
+	if (!destroys_pending) {
+		func(data);
+		return;
+	}
+
+	drained_func = func;
+	drained_data = data;
+}
+
+/* GTK thread */
+void on_command(gpointer elem, gpointer data)
+{
+	proxy_cmd *cmd = elem;
+	proxy_window *window = cmd->window;
+	proxy_event event;
+	lui_dialog_args args;
+
+	switch (cmd->type) {
+	case CMD_INIT:
+		ui->init(init_argc, init_argv);
+		break;
+	case CMD_BUILD:
+		args.accepted = cmd->accepted;
+		args.requestor = cmd->requestor;
+		window->real = ui->build(cmd->kind, &args, window);
+		break;
+	case CMD_BUILD_STACK:
+		window->real = ui->build_stack(cmd->n, cmd->kinds, cmd->stack,
+					       window);
+		g_free(cmd->stack);
+		g_free(cmd->kinds);
+		break;
+	case CMD_PRESENT:
+		window->ui_serial = cmd->serial;
+		ui->present(window->real);
+		break;
+	case CMD_HIDE:
+		ui->hide(window->real);
+		break;
+	case CMD_RESET:
+		ui->reset(window->real);
+		break;
+	case CMD_ANSWER:
+		ui->answer(window->real);
+		break;
+	case CMD_DESTROY:
+		ui->destroy(window->real);
+		event.type = EVENT_DESTROYED;
+		event.window = window;
+		lui_spsc_push_defer(&events, &event);
+		break;
+	case CMD_QUIT:
+		g_main_loop_quit(ui_loop);
+		break;
+	}
+}
+
+/* GTK thread, the real renderer got an answer */
+void on_ui_response(gpointer owner, int code, gpointer data)
+{
+	proxy_window *window = owner;
+	proxy_event event;
+
+	event.type = EVENT_RESPONSE;
+	event.window = window;
+	event.code = code;
+	event.serial = window->ui_serial;
+	lui_spsc_push_defer(&events, &event);
+}
+
+/* Bus thread */
+void on_event(gpointer elem, gpointer data)
+{
+	proxy_event *event = elem;
+	proxy_window *window = event->window;
+	void (*func)(gpointer);
+
+	switch (event->type) {
+	case EVENT_RESPONSE:
+		/* Answers to a presentation that was since taken back */
+		if (window->dead || !window->shown ||
+		    event->serial != window->serial)
+			break;
+		core_func(window->owner, event->code, core_data);
+		break;
+	case EVENT_DESTROYED:
+		g_slice_free(proxy_window, window);
+		if (--destroys_pending || !drained_func)
+			break;
+		func = drained_func;
+		drained_func = NULL;
+		func(drained_data);
+		break;
+	}
+}
+
+void proxy_push(proxy_cmd_type type, proxy_window * window)
+{
+	proxy_cmd cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = type;
+	cmd.window = window;
+	if (window)
+		cmd.serial = window->serial;
+	lui_spsc_push_wait(&commands, &cmd);
+}
+
+void proxy_init(int *argc, char ***argv)
+{
+	init_argc = argc;
+	init_argv = argv;
+	proxy_push(CMD_INIT, NULL);
+}
+
+lui_window *proxy_build(lui_dialog_kind kind, const lui_dialog_args * args,
+			gpointer owner)
+{
+	proxy_window *window = g_slice_new0(proxy_window);
+	proxy_cmd cmd;
+
+	window->owner = owner;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = CMD_BUILD;
+	cmd.window = window;
+	cmd.kind = kind;
+	cmd.accepted = args->accepted;
+	cmd.requestor = g_intern_string(args->requestor ?
+					args->requestor : "");
+	lui_spsc_push_wait(&commands, &cmd);
+
+	return (lui_window *) window;
+}
+
+lui_window *proxy_build_stack(guint n, const lui_dialog_kind * kinds,
+			      const lui_dialog_args * args, gpointer owner)
+{
+	proxy_window *window = g_slice_new0(proxy_window);
+	proxy_cmd cmd;
+	guint i;
+
+	window->owner = owner;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = CMD_BUILD_STACK;
+	cmd.window = window;
+	cmd.n = n;
+	cmd.kinds = g_memdup(kinds, n * sizeof(*kinds));
+	cmd.stack = g_new(lui_dialog_args, n);
+	for (i = 0; i < n; i++) {
+		cmd.stack[i].accepted = args[i].accepted;
+		cmd.stack[i].requestor = g_intern_string(args[i].requestor ?
+							 args[i].requestor :
+							 "");
+	}
+	lui_spsc_push_wait(&commands, &cmd);
+
+	return (lui_window *) window;
+}
+
+void proxy_set_owner(lui_window * w, gpointer owner)
+{
+	((proxy_window *) w)->owner = owner;
+}
+
+void proxy_present(lui_window * w)
+{
+	proxy_window *window = (proxy_window *) w;
+
+	window->serial++;
+	window->shown = TRUE;
+	proxy_push(CMD_PRESENT, window);
+}
+
+void proxy_hide(lui_window * w)
+{
+	((proxy_window *) w)->shown = FALSE;
+	proxy_push(CMD_HIDE, (proxy_window *) w);
+}
+
+void proxy_reset(lui_window * w)
+{
+	proxy_push(CMD_RESET, (proxy_window *) w);
+}
+
+void proxy_answer(lui_window * w)
+{
+	proxy_push(CMD_ANSWER, (proxy_window *) w);
+}
+
+void proxy_destroy(lui_window * w)
+{
+	proxy_window *window = (proxy_window *) w;
+
+	window->dead = TRUE;
+	window->shown = FALSE;
+	destroys_pending++;
+	proxy_push(CMD_DESTROY, window);
+}
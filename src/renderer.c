@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "renderer.h"
+
+/* macros */
+#define nelem(x) (sizeof (x) / sizeof *(x))
+
+static const lui_renderer *renderers[] = {
+#ifndef LUI_HEADLESS
+	&lui_renderer_hildon,
+#endif
+	&lui_renderer_null,
+};
+
+static lui_response_func response_func;
+static gpointer response_data;
+
+const lui_renderer *lui_renderer_find(const char *name)
+{
+	int i;
+
+	for (i = 0; i < nelem(renderers); i++)
+		if (!g_strcmp0(renderers[i]->name, name))
+			return renderers[i];
+
+	return NULL;
+}
+
+void lui_renderer_connect(lui_response_func func, gpointer data)
+{
+	response_func = func;
+	response_data = data;
+}
+
+void lui_renderer_respond(gpointer owner, int code)
+{
+	g_assert(response_func != NULL);
+	response_func(owner, code, response_data);
+}
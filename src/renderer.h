@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCATION_UI_RENDERER_H__
+#define __LOCATION_UI_RENDERER_H__
+
+#include <glib.h>
+
+typedef enum {
+	LUI_DIALOG_BT_DISCONNECTED,
+	LUI_DIALOG_DISCLAIMER,
+	LUI_DIALOG_ENABLE_GPS,
+	LUI_DIALOG_ENABLE_NETWORK,
+	LUI_DIALOG_ENABLE_POSITIONING,
+	LUI_DIALOG_ENABLE_AGNSS,
+	LUI_DIALOG_PRIVACY_VERIFICATION,
+	LUI_DIALOG_PRIVACY_INFORMATION,
+	LUI_DIALOG_PRIVACY_TIMEOUT,
+	LUI_DIALOG_PRIVACY_EXPIRED,
+	LUI_DIALOG_DEFAULT_SUPL,
+	LUI_DIALOG_KINDS
+} lui_dialog_kind;
+
+/* Contents of a client request dialog, only read while building */
+typedef struct lui_dialog_args {
+	int accepted;
+	const char *requestor;
+} lui_dialog_args;
+
+/* A dialog as the renderer knows it, opaque to the scheduler */
+typedef struct lui_window lui_window;
+
+/* Tells the owner of a window which answer it got */
+typedef void (*lui_response_func)(gpointer owner, int code, gpointer data);
+
+/*
+ * Everything that puts a dialog in front of the user. The scheduler and
+ * the D-Bus side only go through this, so they can be run without a
+ * display. A renderer reports answers with lui_renderer_respond().
+ */
+typedef struct lui_renderer {
+	const char *name;
+	void (*init)(int *, char ***);
+	lui_window *(*build)(lui_dialog_kind, const lui_dialog_args *,
+			     gpointer owner);
+	/* One window listing n information notes, acknowledged once */
+	lui_window *(*build_stack)(guint n, const lui_dialog_kind *,
+				   const lui_dialog_args *, gpointer owner);
+	void (*set_owner)(lui_window *, gpointer);
+	void (*present)(lui_window *);
+	void (*hide)(lui_window *);
+	void (*reset)(lui_window *);	/* back to defaults for reuse */
+	void (*answer)(lui_window *);	/* accept on the user's behalf */
+	void (*destroy)(lui_window *);
+} lui_renderer;
+
+extern const lui_renderer lui_renderer_hildon;
+extern const lui_renderer lui_renderer_null;
+
+const lui_renderer *lui_renderer_find(const char *);
+void lui_renderer_connect(lui_response_func, gpointer);
+void lui_renderer_respond(gpointer, int);
+
+gboolean lui_renderer_null_script(guint, guint, const char *);
+
+const lui_renderer *lui_renderer_thread_new(const lui_renderer *,
+					    GMainContext *, GMainLoop *,
+					    lui_response_func, gpointer);
+void lui_renderer_thread_quit(void);
+void lui_renderer_thread_drained(void (*)(gpointer), gpointer);
+
+#endif
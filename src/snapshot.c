@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+
+#include "mapfile.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_FILE "location-ui.snapshot"
+
+static gsize snapshot_size(guint records)
+{
+	return sizeof(lui_snapshot_header) +
+	    records * sizeof(lui_snapshot_record);
+}
+
+void lui_snapshot_open(lui_snapshot * s, guint records)
+{
+	lui_snapshot_header *h;
+
+	memset(s, 0, sizeof(*s));
+	h = lui_mapfile_open(SNAPSHOT_FILE, snapshot_size(records));
+	if (!h)
+		return;
+
+	/* Anything written by a different layout is of no use */
+	if (memcmp(h->magic, LUI_SNAPSHOT_MAGIC, sizeof(h->magic)) ||
+	    h->version != LUI_SNAPSHOT_VERSION ||
+	    h->record_size != sizeof(lui_snapshot_record) ||
+	    h->records != records) {
+		memset(h, 0, snapshot_size(records));
+		memcpy(h->magic, LUI_SNAPSHOT_MAGIC, sizeof(h->magic));
+		h->version = LUI_SNAPSHOT_VERSION;
+		h->record_size = sizeof(lui_snapshot_record);
+		h->records = records;
+	}
+
+	s->header = h;
+	s->record = (lui_snapshot_record *) (h + 1);
+	s->records = records;
+}
+
+void lui_snapshot_close(lui_snapshot * s)
+{
+	if (s->header)
+		lui_mapfile_close(s->header, snapshot_size(s->records));
+	s->header = NULL;
+	s->record = NULL;
+}
+
+/* Invalidate a record for rewriting, NULL while disabled */
+lui_snapshot_record *lui_snapshot_begin(lui_snapshot * s, guint index)
+{
+	lui_snapshot_record *r;
+
+	if (!s->header || index >= s->records)
+		return NULL;
+
+	r = &s->record[index];
+	g_atomic_int_set(&r->used, 0);
+	memset((char *)r + sizeof(r->used), 0, sizeof(*r) - sizeof(r->used));
+	return r;
+}
+
+/* Mark a record complete, a crash before this leaves it unused */
+void lui_snapshot_commit(lui_snapshot_record * r)
+{
+	g_atomic_int_set(&r->used, 1);
+}
+
+void lui_snapshot_clear(lui_snapshot * s, guint index)
+{
+	if (s->header && index < s->records)
+		g_atomic_int_set(&s->record[index].used, 0);
+}
+
+/* FALSE if src does not fit */
+gboolean lui_snapshot_copy(char *dest, const char *src, gsize size)
+{
+	return g_strlcpy(dest, src ? src : "", size) < size;
+}
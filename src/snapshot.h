@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCATION_UI_SNAPSHOT_H__
+#define __LOCATION_UI_SNAPSHOT_H__
+
+#include <glib.h>
+
+#define LUI_SNAPSHOT_MAGIC   "LUISNAPS"
+#define LUI_SNAPSHOT_VERSION 1
+
+/* Longer strings are not snapshotted, such dialogs are not restored */
+#define LUI_SNAPSHOT_NAME 64
+#define LUI_SNAPSHOT_TEXT 128
+
+#define LUI_SNAPSHOT_REQUESTOR	0x1
+#define LUI_SNAPSHOT_CLIENT	0x2
+#define LUI_SNAPSHOT_DECIDED	0x4
+
+/* The state of one dialog, kept up to date as it changes */
+typedef struct lui_snapshot_record {
+	volatile gint used;	/* set last, cleared first */
+	guint32 id;		/* dialog handle, 0 for a static dialog */
+	guint8 kind;		/* lui_dialog_kind */
+	guint8 active;		/* dialog_active */
+	guint8 flags;
+	guint8 reserved;
+	gint32 code;
+	gint32 arg;
+	gint32 priority;
+	gint32 accepted;
+	gint64 deadline;	/* wall clock, microseconds, 0 for none */
+	char requester[LUI_SNAPSHOT_NAME];
+	char requestor[LUI_SNAPSHOT_TEXT];
+	char client[LUI_SNAPSHOT_TEXT];
+} lui_snapshot_record;
+
+typedef struct lui_snapshot_header {
+	char magic[8];
+	guint32 version;
+	guint32 record_size;
+	guint32 records;
+	guint32 reserved;
+} lui_snapshot_header;
+
+/*
+ * Mirror of the dialog state in a mapped file, one record per dialog
+ * slot, so a new instance can pick up what the previous one left after
+ * an idle exit or a crash.
+ */
+typedef struct lui_snapshot {
+	lui_snapshot_header *header;	/* NULL while disabled */
+	lui_snapshot_record *record;
+	guint records;
+	guint restored;
+} lui_snapshot;
+
+void lui_snapshot_open(lui_snapshot *, guint records);
+void lui_snapshot_close(lui_snapshot *);
+lui_snapshot_record *lui_snapshot_begin(lui_snapshot *, guint index);
+void lui_snapshot_commit(lui_snapshot_record *);
+void lui_snapshot_clear(lui_snapshot *, guint index);
+gboolean lui_snapshot_copy(char *dest, const char *src, gsize size);
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib-unix.h>
+
+#include "spsc.h"
+
+typedef struct spsc_watch {
+	lui_spsc *q;
+	lui_spsc_func func;
+	gpointer data;
+	char elem[];
+} spsc_watch;
+
+static gboolean on_spsc_wake(gint fd, GIOCondition cond, gpointer user)
+{
+	spsc_watch *w = user;
+	char buf[16];
+
+	while (read(fd, buf, sizeof(buf)) > 0) ;
+
+	/* Pushes from here on send a new wakeup, so nothing is stranded */
+	g_atomic_int_set(&w->q->wake_pending, 0);
+	while (lui_spsc_pop(w->q, w->elem))
+		w->func(w->elem, w->data);
+
+	return TRUE;
+}
+
+gboolean lui_spsc_init(lui_spsc * q, guint capacity, guint elem_size)
+{
+	memset(q, 0, sizeof(*q));
+	g_return_val_if_fail(capacity && !(capacity & (capacity - 1)), FALSE);
+
+	if (pipe(q->wake_fd))
+		return FALSE;
+	fcntl(q->wake_fd[0], F_SETFL, O_NONBLOCK);
+	fcntl(q->wake_fd[1], F_SETFL, O_NONBLOCK);
+	fcntl(q->wake_fd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(q->wake_fd[1], F_SETFD, FD_CLOEXEC);
+
+	q->slots = g_malloc0(capacity * elem_size);
+	q->elem_size = elem_size;
+	q->mask = capacity - 1;
+	return TRUE;
+}
+
+/* Deliver every record to func, from context */
+void lui_spsc_attach(lui_spsc * q, GMainContext * context,
+		     lui_spsc_func func, gpointer data)
+{
+	spsc_watch *w = g_malloc(sizeof(*w) + q->elem_size);
+
+	w->q = q;
+	w->func = func;
+	w->data = data;
+
+	q->source = g_unix_fd_source_new(q->wake_fd[0], G_IO_IN);
+	g_source_set_priority(q->source, G_PRIORITY_HIGH);
+	g_source_set_callback(q->source, (GSourceFunc) on_spsc_wake, w,
+			      g_free);
+	g_source_attach(q->source, context);
+}
+
+/* Producer side, FALSE if the queue is full */
+gboolean lui_spsc_push(lui_spsc * q, gconstpointer elem)
+{
+	gint head = q->head;
+
+	if ((guint) (head - g_atomic_int_get(&q->tail)) > q->mask)
+		return FALSE;
+
+	memcpy(q->slots + (head & q->mask) * q->elem_size, elem, q->elem_size);
+	g_atomic_int_set(&q->head, head + 1);
+
+	if (g_atomic_int_compare_and_exchange(&q->wake_pending, 0, 1))
+		while (write(q->wake_fd[1], "", 1) < 0 && errno == EINTR) ;
+
+	return TRUE;
+}
+
+/* Producer side, for records that must not be lost */
+void lui_spsc_push_wait(lui_spsc * q, gconstpointer elem)
+{
+	while (!lui_spsc_push(q, elem))
+		g_usleep(100);
+}
+
+/* Producer side, move what waits in the backlog into the queue */
+static gboolean spsc_flush_backlog(lui_spsc * q)
+{
+	gpointer elem;
+
+	while ((elem = g_queue_peek_head(&q->backlog))) {
+		if (!lui_spsc_push(q, elem))
+			return FALSE;
+		g_queue_pop_head(&q->backlog);
+		g_free(elem);
+	}
+
+	return TRUE;
+}
+
+static gboolean on_spsc_retry(gpointer data)
+{
+	lui_spsc *q = data;
+
+	if (!spsc_flush_backlog(q))
+		return TRUE;
+
+	g_source_unref(q->retry);
+	q->retry = NULL;
+	return FALSE;
+}
+
+/*
+ * Producer side, for records that must not be lost by a producer that
+ * must not block either. What does not fit is kept in order and retried
+ * from the producer's thread default context.
+ */
+void lui_spsc_push_defer(lui_spsc * q, gconstpointer elem)
+{
+	if (spsc_flush_backlog(q) && lui_spsc_push(q, elem))
+		return;
+
+	g_queue_push_tail(&q->backlog, g_memdup(elem, q->elem_size));
+	if (q->retry)
+		return;
+
+	q->retry = g_timeout_source_new(1);
+	g_source_set_callback(q->retry, on_spsc_retry, q, NULL);
+	g_source_attach(q->retry, g_main_context_get_thread_default());
+}
+
+/* Consumer side, FALSE if the queue is empty */
+gboolean lui_spsc_pop(lui_spsc * q, gpointer elem)
+{
+	gint tail = q->tail;
+
+	if (tail == g_atomic_int_get(&q->head))
+		return FALSE;
+
+	memcpy(elem, q->slots + (tail & q->mask) * q->elem_size, q->elem_size);
+	g_atomic_int_set(&q->tail, tail + 1);
+	return TRUE;
+}
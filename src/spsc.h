@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCATION_UI_SPSC_H__
+#define __LOCATION_UI_SPSC_H__
+
+#include <glib.h>
+
+/*
+ * Bounded single producer, single consumer queue of fixed size records.
+ * Each side only ever writes its own index, so no lock is taken. The
+ * consumer is woken through a pipe watched from its main context; at
+ * most one wakeup byte is in flight at a time.
+ */
+typedef struct lui_spsc {
+	char *slots;
+	guint elem_size;
+	guint mask;		/* capacity - 1, capacity is a power of two */
+	volatile gint head;	/* next slot to fill, producer owned */
+	volatile gint tail;	/* next slot to read, consumer owned */
+	volatile gint wake_pending;
+	int wake_fd[2];
+	GSource *source;
+	GQueue backlog;		/* producer owned, records that did not fit */
+	GSource *retry;
+} lui_spsc;
+
+typedef void (*lui_spsc_func)(gpointer elem, gpointer data);
+
+gboolean lui_spsc_init(lui_spsc *, guint capacity, guint elem_size);
+void lui_spsc_attach(lui_spsc *, GMainContext *, lui_spsc_func, gpointer);
+gboolean lui_spsc_push(lui_spsc *, gconstpointer);
+void lui_spsc_push_wait(lui_spsc *, gconstpointer);
+void lui_spsc_push_defer(lui_spsc *, gconstpointer);
+gboolean lui_spsc_pop(lui_spsc *, gpointer);
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+
+#include "stats.h"
+
+static const char *phase_names[LUI_STAMPS] = {
+	[LUI_STAMP_ENQUEUE] = "total",
+	[LUI_STAMP_SCHEDULE] = "queued",
+	[LUI_STAMP_BUILT] = "build",
+	[LUI_STAMP_PRESENTED] = "present",
+	[LUI_STAMP_RESPONDED] = "respond",
+	[LUI_STAMP_CLOSED] = "close",
+};
+
+void lui_stats_init(lui_stats * stats)
+{
+	stats->groups = g_ptr_array_new();
+}
+
+/* name must outlive the group */
+lui_stats_group *lui_stats_group_add(lui_stats * stats, const char *name)
+{
+	lui_stats_group *group = g_new0(lui_stats_group, 1);
+
+	group->name = name;
+	g_ptr_array_add(stats->groups, group);
+	return group;
+}
+
+void lui_histogram_add(lui_histogram * h, gint64 us)
+{
+	guint bucket;
+
+	if (us < 0)
+		us = 0;
+
+	/* g_bit_storage() takes a gulong, which may be 32 bits wide */
+	if (us > G_MAXUINT32)
+		bucket = LUI_HISTOGRAM_BUCKETS - 1;
+	else
+		bucket = us ? g_bit_storage((gulong) us) - 1 : 0;
+	if (bucket >= LUI_HISTOGRAM_BUCKETS)
+		bucket = LUI_HISTOGRAM_BUCKETS - 1;
+
+	h->count++;
+	h->sum += us;
+	if ((guint64) us > h->max)
+		h->max = us;
+	h->buckets[bucket]++;
+}
+
+/*
+ * Mark that a dialog reached a point and account the time since the last
+ * one it passed. Enqueueing starts a fresh record, closing ends it.
+ */
+void lui_stats_stamp(lui_stats_group * group, gint64 * stamps,
+		     lui_stamp which)
+{
+	gint64 now = g_get_monotonic_time();
+	int prev;
+
+	if (which == LUI_STAMP_ENQUEUE) {
+		memset(stamps, 0, sizeof(*stamps) * LUI_STAMPS);
+		stamps[which] = now;
+		return;
+	}
+
+	/* Never queued, so there is nothing to measure against */
+	if (!stamps[LUI_STAMP_ENQUEUE])
+		return;
+
+	for (prev = which - 1; prev > LUI_STAMP_ENQUEUE && !stamps[prev];
+	     prev--) ;
+
+	if (group)
+		lui_histogram_add(&group->phases[which], now - stamps[prev]);
+	stamps[which] = now;
+
+	if (which == LUI_STAMP_CLOSED) {
+		if (group)
+			lui_histogram_add(&group->phases[LUI_STAMP_ENQUEUE],
+					  now - stamps[LUI_STAMP_ENQUEUE]);
+		memset(stamps, 0, sizeof(*stamps) * LUI_STAMPS);
+	}
+}
+
+const char *lui_stats_phase_name(lui_stamp which)
+{
+	return phase_names[which];
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCATION_UI_STATS_H__
+#define __LOCATION_UI_STATS_H__
+
+#include <glib.h>
+
+/* Points in the life of a dialog, in the order they are passed */
+typedef enum {
+	LUI_STAMP_ENQUEUE,
+	LUI_STAMP_SCHEDULE,
+	LUI_STAMP_BUILT,
+	LUI_STAMP_PRESENTED,
+	LUI_STAMP_RESPONDED,
+	LUI_STAMP_CLOSED,
+	LUI_STAMPS
+} lui_stamp;
+
+/* Bucket n counts durations of [2^n, 2^(n+1)) us, bucket 0 also 0 us */
+#define LUI_HISTOGRAM_BUCKETS 32
+
+typedef struct lui_histogram {
+	guint64 count;
+	guint64 sum;		/* microseconds */
+	guint64 max;
+	guint64 buckets[LUI_HISTOGRAM_BUCKETS];
+} lui_histogram;
+
+/*
+ * Timings of one dialog path or request type. phases[n] holds the time
+ * from the previous stamp to stamp n, phases[LUI_STAMP_ENQUEUE] the whole
+ * way from enqueue to close.
+ */
+typedef struct lui_stats_group {
+	const char *name;
+	lui_histogram phases[LUI_STAMPS];
+} lui_stats_group;
+
+typedef struct lui_stats {
+	GPtrArray *groups;
+} lui_stats;
+
+void lui_stats_init(lui_stats *);
+lui_stats_group *lui_stats_group_add(lui_stats *, const char *);
+void lui_stats_stamp(lui_stats_group *, gint64 *, lui_stamp);
+const char *lui_stats_phase_name(lui_stamp);
+void lui_histogram_add(lui_histogram *, gint64);
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "renderer.h"
+#include "trace.h"
+
+lui_trace_event lui_trace_ring[LUI_TRACE_EVENTS];
+guint32 lui_trace_head;
+
+static const char *type_names[LUI_TRACE_TYPES] = {
+	[LUI_TRACE_REQUEST] = "request",
+	[LUI_TRACE_DISPLAY] = "display",
+	[LUI_TRACE_CLOSE] = "close",
+	[LUI_TRACE_ENQUEUE] = "enqueue",
+	[LUI_TRACE_SCHEDULE] = "schedule",
+	[LUI_TRACE_PRESENT] = "present",
+	[LUI_TRACE_RESPONSE] = "response",
+	[LUI_TRACE_FLUSH] = "flush",
+	[LUI_TRACE_IDLE] = "idle",
+	[LUI_TRACE_TIMEOUT] = "timeout",
+	[LUI_TRACE_PRESSURE] = "pressure",
+};
+
+static const char *kind_names[LUI_DIALOG_KINDS] = {
+	[LUI_DIALOG_BT_DISCONNECTED] = "bt_disconnected",
+	[LUI_DIALOG_DISCLAIMER] = "disclaimer",
+	[LUI_DIALOG_ENABLE_GPS] = "enable_gps",
+	[LUI_DIALOG_ENABLE_NETWORK] = "enable_network",
+	[LUI_DIALOG_ENABLE_POSITIONING] = "enable_positioning",
+	[LUI_DIALOG_ENABLE_AGNSS] = "enable_agnss",
+	[LUI_DIALOG_PRIVACY_VERIFICATION] = "location_verification",
+	[LUI_DIALOG_PRIVACY_INFORMATION] = "location_information",
+	[LUI_DIALOG_PRIVACY_TIMEOUT] = "location_timeout",
+	[LUI_DIALOG_PRIVACY_EXPIRED] = "location_expired",
+	[LUI_DIALOG_DEFAULT_SUPL] = "location_default_supl",
+};
+
+gchar *lui_trace_default_path(void)
+{
+	return g_build_filename(g_get_user_runtime_dir(), LUI_TRACE_FILE,
+				NULL);
+}
+
+/* Write the ring out, oldest event first */
+gboolean lui_trace_dump(const char *path)
+{
+	lui_trace_header header;
+	guint32 head = lui_trace_head, first, n;
+	FILE *f;
+
+	n = MIN(head, LUI_TRACE_EVENTS);
+	first = (head - n) & (LUI_TRACE_EVENTS - 1);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, LUI_TRACE_MAGIC, sizeof(header.magic));
+	header.version = LUI_TRACE_VERSION;
+	header.event_size = sizeof(lui_trace_event);
+	header.count = n;
+	header.dropped = head - n;
+	header.monotonic = g_get_monotonic_time();
+	header.realtime = g_get_real_time();
+
+	if (!(f = fopen(path, "wb"))) {
+		g_warning("%s: cannot open %s", G_STRFUNC, path);
+		return FALSE;
+	}
+
+	/* The ring wraps at most once between first and head */
+	fwrite(&header, sizeof(header), 1, f);
+	if (first + n > LUI_TRACE_EVENTS) {
+		fwrite(&lui_trace_ring[first], sizeof(lui_trace_event),
+		       LUI_TRACE_EVENTS - first, f);
+		fwrite(lui_trace_ring, sizeof(lui_trace_event),
+		       n - (LUI_TRACE_EVENTS - first), f);
+	} else {
+		fwrite(&lui_trace_ring[first], sizeof(lui_trace_event), n, f);
+	}
+
+	if (fclose(f)) {
+		g_warning("%s: cannot write %s", G_STRFUNC, path);
+		return FALSE;
+	}
+
+	g_message("trace: %u events written to %s", n, path);
+	return TRUE;
+}
+
+const char *lui_trace_type_name(guint type)
+{
+	return type < LUI_TRACE_TYPES ? type_names[type] : "?";
+}
+
+const char *lui_trace_kind_name(guint kind)
+{
+	return kind < LUI_DIALOG_KINDS ? kind_names[kind] : "-";
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCATION_UI_TRACE_H__
+#define __LOCATION_UI_TRACE_H__
+
+#include <glib.h>
+
+/* Number of events kept, must be a power of two */
+#define LUI_TRACE_EVENTS 4096
+
+#define LUI_TRACE_MAGIC   "LUITRACE"
+#define LUI_TRACE_VERSION 1
+#define LUI_TRACE_FILE    "location-ui.trace"
+
+/* No dialog involved, e.g. for outbox flushes */
+#define LUI_TRACE_NO_KIND 0xff
+
+typedef enum {
+	LUI_TRACE_REQUEST,	/* client request accepted, arg: coalesced */
+	LUI_TRACE_DISPLAY,	/* display call, arg: queued */
+	LUI_TRACE_CLOSE,	/* close call, arg: response code */
+	LUI_TRACE_ENQUEUE,	/* arg: priority */
+	LUI_TRACE_SCHEDULE,	/* picked to be shown, arg: queue depth left */
+	LUI_TRACE_PRESENT,	/* arg: window came from the pool */
+	LUI_TRACE_RESPONSE,	/* arg: response code */
+	LUI_TRACE_FLUSH,	/* outbox handed to the bus, arg: messages */
+	LUI_TRACE_IDLE,		/* exit timer armed, arg: seconds */
+	LUI_TRACE_TIMEOUT,	/* exit timer fired */
+	LUI_TRACE_PRESSURE,	/* memory pressure, arg: pooled windows freed */
+	LUI_TRACE_TYPES
+} lui_trace_type;
+
+/* One event, as stored in the ring and in dump files */
+typedef struct lui_trace_event {
+	gint64 time;		/* monotonic, microseconds */
+	guint32 id;		/* dialog handle, 0 for static dialogs */
+	guint8 type;		/* lui_trace_type */
+	guint8 kind;		/* lui_dialog_kind or LUI_TRACE_NO_KIND */
+	gint16 arg;
+} lui_trace_event;
+
+/* Dump file header, followed by count events oldest first */
+typedef struct lui_trace_header {
+	char magic[8];
+	guint32 version;
+	guint32 event_size;
+	guint32 count;
+	guint32 dropped;	/* events overwritten before the dump */
+	gint64 monotonic;	/* clocks at dump time, to place the events */
+	gint64 realtime;
+} lui_trace_header;
+
+extern lui_trace_event lui_trace_ring[LUI_TRACE_EVENTS];
+extern guint32 lui_trace_head;
+
+/* A handful of stores, cheap enough for every hot path */
+static inline void lui_trace(lui_trace_type type, guint kind, guint32 id,
+			     gint arg)
+{
+	lui_trace_event *e;
+
+	e = &lui_trace_ring[lui_trace_head++ & (LUI_TRACE_EVENTS - 1)];
+	e->time = g_get_monotonic_time();
+	e->id = id;
+	e->type = type;
+	e->kind = kind;
+	e->arg = CLAMP(arg, G_MININT16, G_MAXINT16);
+}
+
+gchar *lui_trace_default_path(void);
+gboolean lui_trace_dump(const char *);
+const char *lui_trace_type_name(guint);
+const char *lui_trace_kind_name(guint);
+
+#endif
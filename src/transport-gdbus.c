@@ -0,0 +1,651 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "spsc.h"
+#include "transport.h"
+
+/* macros */
+#define ITER(i)	((gdbus_iter *) (i))
+
+/* Messages in flight from the worker thread to the core */
+#define GDBUS_DELIVERIES 256
+
+#define REQUEST_NAME_PRIMARY_OWNER 1
+
+/*
+ * GDBus. Incoming messages are picked up in GDBus' worker thread and
+ * passed through a ring to the core's context, where the handlers run
+ * one at a time, just as with libdbus. They read the GVariant bodies in
+ * place; replies are built with a GVariantBuilder and queued with
+ * g_dbus_connection_send_message, which does not wait for them to be
+ * written. libdbus is not involved at all.
+ */
+struct lui_msg {
+	GDBusMessage *message;
+	GVariantBuilder *body;	/* arguments appended so far, until sent */
+	GPtrArray *held;	/* containers recursed into */
+	int refs;		/* only ever touched from the core */
+};
+
+/* Reads a container in place, or appends to a message's builder */
+typedef struct gdbus_iter {
+	lui_msg *msg;
+	GVariant *container;
+	gboolean array;
+	gsize index;
+	gsize n;
+	/* type at index, the element type while appending to an array */
+	const GVariantType *item;
+	GVariantBuilder *builder;
+} gdbus_iter;
+
+G_STATIC_ASSERT(sizeof(gdbus_iter) <= sizeof(lui_msg_iter));
+
+typedef struct gdbus_handler {
+	lui_transport_func func;
+	gpointer data;
+} gdbus_handler;
+
+/* A message on its way from the worker thread to a handler */
+typedef struct gdbus_delivery {
+	gdbus_handler *handler;
+	lui_msg *msg;
+} gdbus_delivery;
+
+/* function declarations */
+static lui_msg *gdbus_wrap(GDBusMessage *);
+static int gdbus_type_code(const GVariantType *);
+static GVariant *gdbus_new_basic(int, const void *);
+static gsize gdbus_fixed_size(int);
+static void gdbus_iter_open(gdbus_iter *, lui_msg *, GVariant *);
+static gboolean gdbus_below_root(const char *);
+static GDBusMessage *on_filter(GDBusConnection *, GDBusMessage *, gboolean,
+			       gpointer);
+static void on_delivery(gpointer, gpointer);
+static void gdbus_bus_call(const char *, GVariant *);
+static lui_msg *gdbus_ref(lui_msg *);
+static void gdbus_unref(lui_msg *);
+static const char *gdbus_path(lui_msg *);
+static const char *gdbus_member(lui_msg *);
+static const char *gdbus_sender(lui_msg *);
+static gboolean gdbus_is_method_call(lui_msg *, const char *, const char *);
+static gboolean gdbus_is_signal(lui_msg *, const char *, const char *);
+static lui_msg *gdbus_new_method_return(lui_msg *);
+static lui_msg *gdbus_new_error(lui_msg *, const char *, const char *);
+static lui_msg *gdbus_new_signal(const char *, const char *, const char *);
+static void gdbus_set_destination(lui_msg *, const char *);
+static gboolean gdbus_iter_init(lui_msg *, lui_msg_iter *);
+static int gdbus_arg_type(lui_msg_iter *);
+static int gdbus_element_type(lui_msg_iter *);
+static gboolean gdbus_next(lui_msg_iter *);
+static void gdbus_get_basic(lui_msg_iter *, void *);
+static void gdbus_recurse(lui_msg_iter *, lui_msg_iter *);
+static void gdbus_init_append(lui_msg *, lui_msg_iter *);
+static void gdbus_append_basic(lui_msg_iter *, int, const void *);
+static void gdbus_append_fixed_array(lui_msg_iter *, int, const void *, int);
+static void gdbus_open_container(lui_msg_iter *, int, const char *,
+				 lui_msg_iter *);
+static void gdbus_close_container(lui_msg_iter *, lui_msg_iter *);
+static gboolean gdbus_connect(GMainContext *);
+static gboolean gdbus_register_object(const char *, lui_transport_func,
+				      gpointer);
+static gboolean gdbus_add_filter(lui_transport_func, gpointer);
+static gboolean gdbus_request_name(const char *);
+static void gdbus_add_match(const char *);
+static void gdbus_remove_match(const char *);
+static gboolean gdbus_send(lui_msg *);
+static void gdbus_flush(void);
+
+/* variables */
+static GDBusConnection *connection;
+static const char *object_root;
+static lui_spsc deliveries;	/* produced by the worker thread only */
+
+/* Set before the name is claimed, only read by the worker afterwards */
+static gdbus_handler object_handler;
+static gdbus_handler signal_handler;
+
+static const lui_msg_ops gdbus_msg_ops = {
+	gdbus_ref,
+	gdbus_unref,
+	gdbus_path,
+	gdbus_member,
+	gdbus_sender,
+	gdbus_is_method_call,
+	gdbus_is_signal,
+	gdbus_new_method_return,
+	gdbus_new_error,
+	gdbus_new_signal,
+	gdbus_set_destination,
+	gdbus_iter_init,
+	gdbus_arg_type,
+	gdbus_element_type,
+	gdbus_next,
+	gdbus_get_basic,
+	gdbus_recurse,
+	gdbus_init_append,
+	gdbus_append_basic,
+	gdbus_append_fixed_array,
+	gdbus_open_container,
+	gdbus_close_container,
+};
+
+const lui_transport lui_transport_gdbus = {
+	"gdbus",
+	&gdbus_msg_ops,
+	gdbus_connect,
+	gdbus_register_object,
+	gdbus_add_filter,
+	gdbus_request_name,
+	gdbus_add_match,
+	gdbus_remove_match,
+	gdbus_send,
+	gdbus_flush,
+};
+
+/* function implementations */
+
+/* Takes over the caller's reference */
+lui_msg *gdbus_wrap(GDBusMessage * message)
+{
+	lui_msg *msg = g_slice_new0(lui_msg);
+
+	msg->message = message;
+	msg->refs = 1;
+	return msg;
+}
+
+/* Containers by their libdbus codes, everything else as in signatures */
+int gdbus_type_code(const GVariantType * type)
+{
+	if (!type)
+		return LUI_TYPE_INVALID;
+	if (g_variant_type_is_tuple(type))
+		return LUI_TYPE_STRUCT;
+	if (g_variant_type_is_dict_entry(type))
+		return LUI_TYPE_DICT_ENTRY;
+
+	return g_variant_type_peek_string(type)[0];
+}
+
+GVariant *gdbus_new_basic(int type, const void *value)
+{
+	switch (type) {
+	case LUI_TYPE_BYTE:
+		return g_variant_new_byte(*(const guchar *)value);
+	case LUI_TYPE_BOOLEAN:
+		return g_variant_new_boolean(*(const gboolean *)value);
+	case LUI_TYPE_INT32:
+		return g_variant_new_int32(*(const gint32 *)value);
+	case LUI_TYPE_UINT32:
+		return g_variant_new_uint32(*(const guint32 *)value);
+	case LUI_TYPE_INT64:
+		return g_variant_new_int64(*(const gint64 *)value);
+	case LUI_TYPE_UINT64:
+		return g_variant_new_uint64(*(const guint64 *)value);
+	case LUI_TYPE_DOUBLE:
+		return g_variant_new_double(*(const gdouble *)value);
+	case LUI_TYPE_STRING:
+		return g_variant_new_string(*(const char *const *)value);
+	case LUI_TYPE_OBJECT_PATH:
+		return g_variant_new_object_path(*(const char *const *)value);
+	}
+
+	g_return_val_if_reached(NULL);
+}
+
+gsize gdbus_fixed_size(int type)
+{
+	switch (type) {
+	case LUI_TYPE_BYTE:
+		return 1;
+	case LUI_TYPE_BOOLEAN:
+	case LUI_TYPE_INT32:
+	case LUI_TYPE_UINT32:
+		return 4;
+	case LUI_TYPE_INT64:
+	case LUI_TYPE_UINT64:
+	case LUI_TYPE_DOUBLE:
+		return 8;
+	}
+
+	g_return_val_if_reached(0);
+}
+
+void gdbus_iter_open(gdbus_iter * iter, lui_msg * msg, GVariant * container)
+{
+	const GVariantType *type;
+
+	memset(iter, 0, sizeof(*iter));
+	iter->msg = msg;
+	if (!container)
+		return;
+
+	type = g_variant_get_type(container);
+	iter->container = container;
+	iter->array = g_variant_type_is_array(type);
+	iter->n = g_variant_n_children(container);
+	if (iter->n)
+		iter->item = iter->array ? g_variant_type_element(type) :
+		    g_variant_type_first(type);
+}
+
+gboolean gdbus_below_root(const char *path)
+{
+	size_t len;
+
+	if (!path || !object_root)
+		return FALSE;
+
+	len = strlen(object_root);
+	return !strncmp(path, object_root, len) &&
+	    (path[len] == '\0' || path[len] == '/');
+}
+
+/* Worker thread. Our method calls are taken, signals are only shared */
+GDBusMessage *on_filter(GDBusConnection * conn, GDBusMessage * message,
+			gboolean incoming, gpointer data)
+{
+	gdbus_delivery delivery;
+	gboolean take;
+
+	if (!incoming)
+		return message;
+
+	switch (g_dbus_message_get_message_type(message)) {
+	case G_DBUS_MESSAGE_TYPE_METHOD_CALL:
+		if (!gdbus_below_root(g_dbus_message_get_path(message)))
+			return message;
+		delivery.handler = &object_handler;
+		take = TRUE;
+		break;
+	case G_DBUS_MESSAGE_TYPE_SIGNAL:
+		delivery.handler = &signal_handler;
+		take = FALSE;
+		break;
+	default:
+		return message;
+	}
+
+	if (!delivery.handler->func)
+		return message;
+
+	/* Waits while the core is a full ring behind, nothing is dropped */
+	delivery.msg = gdbus_wrap(take ? message : g_object_ref(message));
+	lui_spsc_push_wait(&deliveries, &delivery);
+	return take ? NULL : message;
+}
+
+/* Core context, answers what the handler does not for method calls */
+void on_delivery(gpointer elem, gpointer data)
+{
+	gdbus_delivery *delivery = elem;
+	lui_msg *msg = delivery->msg;
+	GDBusMessage *message = msg->message;
+	lui_msg *reply = NULL;
+	lui_msg_result ret;
+	gboolean call;
+
+	call = g_dbus_message_get_message_type(message) ==
+	    G_DBUS_MESSAGE_TYPE_METHOD_CALL;
+	if (call && (reply = lui_transport_introspect(msg, object_root)))
+		ret = LUI_MSG_HANDLED;
+	else
+		ret = delivery->handler->func(msg, delivery->handler->data);
+
+	if (ret == LUI_MSG_NOT_HANDLED && call &&
+	    !(g_dbus_message_get_flags(message) &
+	      G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED))
+		reply = lui_msg_new_error_printf(msg,
+						 LUI_BUS_ERROR_UNKNOWN_METHOD,
+						 "No method %s on %s",
+						 g_dbus_message_get_member
+						 (message),
+						 g_dbus_message_get_path
+						 (message));
+
+	if (reply) {
+		gdbus_send(reply);
+		gdbus_unref(reply);
+	}
+
+	gdbus_unref(msg);
+}
+
+/* Fire and forget, like libdbus without an error argument */
+void gdbus_bus_call(const char *method, GVariant * args)
+{
+	g_dbus_connection_call(connection, LUI_BUS_NAME, LUI_BUS_PATH,
+			       LUI_BUS_INTERFACE, method, args, NULL,
+			       G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+}
+
+lui_msg *gdbus_ref(lui_msg * msg)
+{
+	msg->refs++;
+	return msg;
+}
+
+void gdbus_unref(lui_msg * msg)
+{
+	if (--msg->refs)
+		return;
+
+	if (msg->body)
+		g_variant_builder_unref(msg->body);
+	if (msg->held)
+		g_ptr_array_unref(msg->held);
+	g_object_unref(msg->message);
+	g_slice_free(lui_msg, msg);
+}
+
+const char *gdbus_path(lui_msg * msg)
+{
+	return g_dbus_message_get_path(msg->message);
+}
+
+const char *gdbus_member(lui_msg * msg)
+{
+	return g_dbus_message_get_member(msg->message);
+}
+
+const char *gdbus_sender(lui_msg * msg)
+{
+	return g_dbus_message_get_sender(msg->message);
+}
+
+gboolean gdbus_is_method_call(lui_msg * msg, const char *interface,
+			      const char *member)
+{
+	return g_dbus_message_get_message_type(msg->message) ==
+	    G_DBUS_MESSAGE_TYPE_METHOD_CALL &&
+	    !g_strcmp0(g_dbus_message_get_interface(msg->message), interface)
+	    && !g_strcmp0(g_dbus_message_get_member(msg->message), member);
+}
+
+gboolean gdbus_is_signal(lui_msg * msg, const char *interface,
+			 const char *member)
+{
+	return g_dbus_message_get_message_type(msg->message) ==
+	    G_DBUS_MESSAGE_TYPE_SIGNAL &&
+	    !g_strcmp0(g_dbus_message_get_interface(msg->message), interface)
+	    && !g_strcmp0(g_dbus_message_get_member(msg->message), member);
+}
+
+lui_msg *gdbus_new_method_return(lui_msg * call)
+{
+	return gdbus_wrap(g_dbus_message_new_method_reply(call->message));
+}
+
+lui_msg *gdbus_new_error(lui_msg * call, const char *name,
+			 const char *message)
+{
+	return gdbus_wrap(g_dbus_message_new_method_error_literal
+			  (call->message, name, message));
+}
+
+lui_msg *gdbus_new_signal(const char *path, const char *interface,
+			  const char *member)
+{
+	return gdbus_wrap(g_dbus_message_new_signal(path, interface, member));
+}
+
+void gdbus_set_destination(lui_msg * msg, const char *name)
+{
+	g_dbus_message_set_destination(msg->message, name);
+}
+
+/*
+ * Bodies off the wire are serialised, so the strings of a child value
+ * point into its message's body and outlive the child itself.
+ */
+gboolean gdbus_iter_init(lui_msg * msg, lui_msg_iter * iter)
+{
+	gdbus_iter_open(ITER(iter), msg,
+			g_dbus_message_get_body(msg->message));
+	return ITER(iter)->item != NULL;
+}
+
+int gdbus_arg_type(lui_msg_iter * iter)
+{
+	return gdbus_type_code(ITER(iter)->item);
+}
+
+int gdbus_element_type(lui_msg_iter * iter)
+{
+	const GVariantType *type = ITER(iter)->item;
+
+	if (!type || !g_variant_type_is_array(type))
+		return LUI_TYPE_INVALID;
+
+	return gdbus_type_code(g_variant_type_element(type));
+}
+
+gboolean gdbus_next(lui_msg_iter * iter)
+{
+	gdbus_iter *it = ITER(iter);
+
+	if (!it->item)
+		return FALSE;
+
+	if (++it->index == it->n)
+		it->item = NULL;
+	else if (!it->array)
+		it->item = g_variant_type_next(it->item);
+
+	return it->item != NULL;
+}
+
+void gdbus_get_basic(lui_msg_iter * iter, void *value)
+{
+	gdbus_iter *it = ITER(iter);
+	GVariant *child;
+
+	child = g_variant_get_child_value(it->container, it->index);
+	switch (gdbus_type_code(it->item)) {
+	case LUI_TYPE_BYTE:
+		*(guchar *) value = g_variant_get_byte(child);
+		break;
+	case LUI_TYPE_BOOLEAN:
+		*(gboolean *) value = g_variant_get_boolean(child);
+		break;
+	case LUI_TYPE_INT32:
+		*(gint32 *) value = g_variant_get_int32(child);
+		break;
+	case LUI_TYPE_UINT32:
+		*(guint32 *) value = g_variant_get_uint32(child);
+		break;
+	case LUI_TYPE_INT64:
+		*(gint64 *) value = g_variant_get_int64(child);
+		break;
+	case LUI_TYPE_UINT64:
+		*(guint64 *) value = g_variant_get_uint64(child);
+		break;
+	case LUI_TYPE_DOUBLE:
+		*(gdouble *) value = g_variant_get_double(child);
+		break;
+	case LUI_TYPE_STRING:
+	case LUI_TYPE_OBJECT_PATH:
+		*(const char **)value = g_variant_get_string(child, NULL);
+		break;
+	default:
+		g_warn_if_reached();
+	}
+	g_variant_unref(child);
+}
+
+/* The sub-container lives as long as the message */
+void gdbus_recurse(lui_msg_iter * iter, lui_msg_iter * sub)
+{
+	gdbus_iter *it = ITER(iter);
+	GVariant *child;
+
+	child = g_variant_get_child_value(it->container, it->index);
+	if (!it->msg->held)
+		it->msg->held =
+		    g_ptr_array_new_with_free_func((GDestroyNotify)
+						   g_variant_unref);
+	g_ptr_array_add(it->msg->held, child);
+	gdbus_iter_open(ITER(sub), it->msg, child);
+}
+
+void gdbus_init_append(lui_msg * msg, lui_msg_iter * iter)
+{
+	if (!msg->body)
+		msg->body = g_variant_builder_new(G_VARIANT_TYPE_TUPLE);
+
+	gdbus_iter_open(ITER(iter), msg, NULL);
+	ITER(iter)->builder = msg->body;
+}
+
+void gdbus_append_basic(lui_msg_iter * iter, int type, const void *value)
+{
+	g_variant_builder_add_value(ITER(iter)->builder,
+				    gdbus_new_basic(type, value));
+}
+
+void gdbus_append_fixed_array(lui_msg_iter * iter, int type,
+			      const void *value, int n)
+{
+	const char *elements = *(const void *const *)value;
+	gsize size = gdbus_fixed_size(type);
+	int i;
+
+	for (i = 0; i < n; i++)
+		gdbus_append_basic(iter, type, elements + i * size);
+}
+
+/* Structs and dict entries take their type from the array they are in */
+void gdbus_open_container(lui_msg_iter * iter, int type,
+			  const char *signature, lui_msg_iter * sub)
+{
+	gdbus_iter *it = ITER(iter);
+	char *array_type;
+
+	gdbus_iter_open(ITER(sub), it->msg, NULL);
+	ITER(sub)->builder = it->builder;
+
+	if (type == LUI_TYPE_ARRAY) {
+		array_type = g_strconcat("a", signature, NULL);
+		g_variant_builder_open(it->builder, G_VARIANT_TYPE(array_type));
+		g_free(array_type);
+		ITER(sub)->item = G_VARIANT_TYPE(signature);
+	} else if (it->item) {
+		g_variant_builder_open(it->builder, it->item);
+	} else {
+		g_variant_builder_open(it->builder,
+				       type == LUI_TYPE_STRUCT ?
+				       G_VARIANT_TYPE_TUPLE :
+				       G_VARIANT_TYPE_DICT_ENTRY);
+	}
+}
+
+void gdbus_close_container(lui_msg_iter * iter, lui_msg_iter * sub)
+{
+	g_variant_builder_close(ITER(iter)->builder);
+}
+
+gboolean gdbus_connect(GMainContext * context)
+{
+	if (!lui_spsc_init(&deliveries, GDBUS_DELIVERIES,
+			   sizeof(gdbus_delivery)))
+		return FALSE;
+
+	connection = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL);
+	if (!connection)
+		return FALSE;
+
+	lui_spsc_attach(&deliveries, context, on_delivery, NULL);
+	g_dbus_connection_add_filter(connection, on_filter, NULL, NULL);
+	return TRUE;
+}
+
+gboolean gdbus_register_object(const char *path, lui_transport_func func,
+			       gpointer data)
+{
+	object_handler.func = func;
+	object_handler.data = data;
+	object_root = path;
+	return TRUE;
+}
+
+gboolean gdbus_add_filter(lui_transport_func func, gpointer data)
+{
+	signal_handler.func = func;
+	signal_handler.data = data;
+	return TRUE;
+}
+
+/* Startup only, the answer decides whether we run at all */
+gboolean gdbus_request_name(const char *name)
+{
+	GVariant *result;
+	guint32 reply;
+
+	result = g_dbus_connection_call_sync(connection, LUI_BUS_NAME,
+					     LUI_BUS_PATH, LUI_BUS_INTERFACE,
+					     "RequestName",
+					     g_variant_new("(su)", name, 0),
+					     G_VARIANT_TYPE("(u)"),
+					     G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					     NULL);
+	if (!result)
+		return FALSE;
+
+	g_variant_get(result, "(u)", &reply);
+	g_variant_unref(result);
+	return reply == REQUEST_NAME_PRIMARY_OWNER;
+}
+
+void gdbus_add_match(const char *rule)
+{
+	gdbus_bus_call("AddMatch", g_variant_new("(s)", rule));
+}
+
+void gdbus_remove_match(const char *rule)
+{
+	gdbus_bus_call("RemoveMatch", g_variant_new("(s)", rule));
+}
+
+/* The body is only put together now, a message is sent once */
+gboolean gdbus_send(lui_msg * msg)
+{
+	if (msg->body) {
+		g_dbus_message_set_body(msg->message,
+					g_variant_builder_end(msg->body));
+		g_variant_builder_unref(msg->body);
+		msg->body = NULL;
+	}
+
+	return g_dbus_connection_send_message(connection, msg->message,
+					      G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+					      NULL, NULL);
+}
+
+void gdbus_flush(void)
+{
+	g_dbus_connection_flush_sync(connection, NULL, NULL);
+}
@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include "transport.h"
+
+/* macros */
+#define MSG(m)	((DBusMessage *) (m))
+#define ITER(i)	((DBusMessageIter *) (i))
+
+/*
+ * libdbus, driven by the dbus-glib main loop glue. Messages are read and
+ * handlers run in the context given to connect(); sends are queued with
+ * the connection and written out by its watch once the socket allows.
+ * A lui_msg is the DBusMessage itself, each op is the libdbus call.
+ */
+G_STATIC_ASSERT(sizeof(DBusMessageIter) <= sizeof(lui_msg_iter));
+G_STATIC_ASSERT(LUI_TYPE_STRUCT == DBUS_TYPE_STRUCT);
+G_STATIC_ASSERT(LUI_TYPE_DICT_ENTRY == DBUS_TYPE_DICT_ENTRY);
+
+typedef struct libdbus_handler {
+	lui_transport_func func;
+	gpointer data;
+} libdbus_handler;
+
+/* function declarations */
+static DBusHandlerResult on_object_message(DBusConnection *, DBusMessage *,
+					   void *);
+static DBusHandlerResult on_filter_message(DBusConnection *, DBusMessage *,
+					   void *);
+static DBusHandlerResult libdbus_handle(libdbus_handler *, DBusMessage *);
+static libdbus_handler *libdbus_handler_new(lui_transport_func, gpointer);
+static lui_msg *libdbus_ref(lui_msg *);
+static void libdbus_unref(lui_msg *);
+static const char *libdbus_path(lui_msg *);
+static const char *libdbus_member(lui_msg *);
+static const char *libdbus_sender(lui_msg *);
+static gboolean libdbus_is_method_call(lui_msg *, const char *, const char *);
+static gboolean libdbus_is_signal(lui_msg *, const char *, const char *);
+static lui_msg *libdbus_new_method_return(lui_msg *);
+static lui_msg *libdbus_new_error(lui_msg *, const char *, const char *);
+static lui_msg *libdbus_new_signal(const char *, const char *, const char *);
+static void libdbus_set_destination(lui_msg *, const char *);
+static gboolean libdbus_iter_init(lui_msg *, lui_msg_iter *);
+static int libdbus_arg_type(lui_msg_iter *);
+static int libdbus_element_type(lui_msg_iter *);
+static gboolean libdbus_next(lui_msg_iter *);
+static void libdbus_get_basic(lui_msg_iter *, void *);
+static void libdbus_recurse(lui_msg_iter *, lui_msg_iter *);
+static void libdbus_init_append(lui_msg *, lui_msg_iter *);
+static void libdbus_append_basic(lui_msg_iter *, int, const void *);
+static void libdbus_append_fixed_array(lui_msg_iter *, int, const void *,
+				       int);
+static void libdbus_open_container(lui_msg_iter *, int, const char *,
+				   lui_msg_iter *);
+static void libdbus_close_container(lui_msg_iter *, lui_msg_iter *);
+static gboolean libdbus_connect(GMainContext *);
+static gboolean libdbus_register_object(const char *, lui_transport_func,
+					gpointer);
+static gboolean libdbus_add_filter(lui_transport_func, gpointer);
+static gboolean libdbus_request_name(const char *);
+static void libdbus_add_match(const char *);
+static void libdbus_remove_match(const char *);
+static gboolean libdbus_send(lui_msg *);
+static void libdbus_flush(void);
+
+/* variables */
+static DBusConnection *dbus;
+static const char *object_root;
+
+static DBusObjectPathVTable object_vtable = {
+	NULL, on_object_message, NULL, NULL, NULL, NULL,
+};
+
+static const lui_msg_ops libdbus_msg_ops = {
+	libdbus_ref,
+	libdbus_unref,
+	libdbus_path,
+	libdbus_member,
+	libdbus_sender,
+	libdbus_is_method_call,
+	libdbus_is_signal,
+	libdbus_new_method_return,
+	libdbus_new_error,
+	libdbus_new_signal,
+	libdbus_set_destination,
+	libdbus_iter_init,
+	libdbus_arg_type,
+	libdbus_element_type,
+	libdbus_next,
+	libdbus_get_basic,
+	libdbus_recurse,
+	libdbus_init_append,
+	libdbus_append_basic,
+	libdbus_append_fixed_array,
+	libdbus_open_container,
+	libdbus_close_container,
+};
+
+const lui_transport lui_transport_libdbus = {
+	"libdbus",
+	&libdbus_msg_ops,
+	libdbus_connect,
+	libdbus_register_object,
+	libdbus_add_filter,
+	libdbus_request_name,
+	libdbus_add_match,
+	libdbus_remove_match,
+	libdbus_send,
+	libdbus_flush,
+};
+
+/* function implementations */
+DBusHandlerResult on_object_message(DBusConnection * conn, DBusMessage * msg,
+				    void *data)
+{
+	libdbus_handler *handler = data;
+	DBusMessage *reply;
+
+	reply = MSG(lui_transport_introspect((lui_msg *) msg, object_root));
+	if (reply) {
+		dbus_connection_send(conn, reply, NULL);
+		dbus_message_unref(reply);
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
+	/* libdbus sends UnknownMethod for what is left unhandled */
+	return libdbus_handle(handler, msg);
+}
+
+DBusHandlerResult on_filter_message(DBusConnection * conn, DBusMessage * msg,
+				    void *data)
+{
+	libdbus_handler *handler = data;
+
+	if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_SIGNAL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	return libdbus_handle(handler, msg);
+}
+
+DBusHandlerResult libdbus_handle(libdbus_handler * handler, DBusMessage * msg)
+{
+	if (handler->func((lui_msg *) msg, handler->data) == LUI_MSG_HANDLED)
+		return DBUS_HANDLER_RESULT_HANDLED;
+
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+/* Registrations last as long as the process */
+libdbus_handler *libdbus_handler_new(lui_transport_func func, gpointer data)
+{
+	libdbus_handler *handler = g_new(libdbus_handler, 1);
+
+	handler->func = func;
+	handler->data = data;
+	return handler;
+}
+
+lui_msg *libdbus_ref(lui_msg * msg)
+{
+	return (lui_msg *) dbus_message_ref(MSG(msg));
+}
+
+void libdbus_unref(lui_msg * msg)
+{
+	dbus_message_unref(MSG(msg));
+}
+
+const char *libdbus_path(lui_msg * msg)
+{
+	return dbus_message_get_path(MSG(msg));
+}
+
+const char *libdbus_member(lui_msg * msg)
+{
+	return dbus_message_get_member(MSG(msg));
+}
+
+const char *libdbus_sender(lui_msg * msg)
+{
+	return dbus_message_get_sender(MSG(msg));
+}
+
+gboolean libdbus_is_method_call(lui_msg * msg, const char *interface,
+				const char *member)
+{
+	return dbus_message_is_method_call(MSG(msg), interface, member);
+}
+
+gboolean libdbus_is_signal(lui_msg * msg, const char *interface,
+			   const char *member)
+{
+	return dbus_message_is_signal(MSG(msg), interface, member);
+}
+
+lui_msg *libdbus_new_method_return(lui_msg * call)
+{
+	return (lui_msg *) dbus_message_new_method_return(MSG(call));
+}
+
+lui_msg *libdbus_new_error(lui_msg * call, const char *name,
+			   const char *message)
+{
+	return (lui_msg *) dbus_message_new_error(MSG(call), name, message);
+}
+
+lui_msg *libdbus_new_signal(const char *path, const char *interface,
+			    const char *member)
+{
+	return (lui_msg *) dbus_message_new_signal(path, interface, member);
+}
+
+void libdbus_set_destination(lui_msg * msg, const char *name)
+{
+	dbus_message_set_destination(MSG(msg), name);
+}
+
+gboolean libdbus_iter_init(lui_msg * msg, lui_msg_iter * iter)
+{
+	return dbus_message_iter_init(MSG(msg), ITER(iter));
+}
+
+int libdbus_arg_type(lui_msg_iter * iter)
+{
+	return dbus_message_iter_get_arg_type(ITER(iter));
+}
+
+int libdbus_element_type(lui_msg_iter * iter)
+{
+	return dbus_message_iter_get_element_type(ITER(iter));
+}
+
+gboolean libdbus_next(lui_msg_iter * iter)
+{
+	return dbus_message_iter_next(ITER(iter));
+}
+
+void libdbus_get_basic(lui_msg_iter * iter, void *value)
+{
+	dbus_message_iter_get_basic(ITER(iter), value);
+}
+
+void libdbus_recurse(lui_msg_iter * iter, lui_msg_iter * sub)
+{
+	dbus_message_iter_recurse(ITER(iter), ITER(sub));
+}
+
+void libdbus_init_append(lui_msg * msg, lui_msg_iter * iter)
+{
+	dbus_message_iter_init_append(MSG(msg), ITER(iter));
+}
+
+void libdbus_append_basic(lui_msg_iter * iter, int type, const void *value)
+{
+	dbus_message_iter_append_basic(ITER(iter), type, value);
+}
+
+void libdbus_append_fixed_array(lui_msg_iter * iter, int type,
+				const void *value, int n)
+{
+	dbus_message_iter_append_fixed_array(ITER(iter), type, value, n);
+}
+
+void libdbus_open_container(lui_msg_iter * iter, int type,
+			    const char *signature, lui_msg_iter * sub)
+{
+	dbus_message_iter_open_container(ITER(iter), type, signature,
+					 ITER(sub));
+}
+
+void libdbus_close_container(lui_msg_iter * iter, lui_msg_iter * sub)
+{
+	dbus_message_iter_close_container(ITER(iter), ITER(sub));
+}
+
+/* The core runs in a thread of its own */
+gboolean libdbus_connect(GMainContext * context)
+{
+	dbus_threads_init_default();
+	dbus = dbus_bus_get(DBUS_BUS_SYSTEM, NULL);
+	if (!dbus)
+		return FALSE;
+
+	dbus_connection_setup_with_g_main(dbus, context);
+	return TRUE;
+}
+
+gboolean libdbus_register_object(const char *path, lui_transport_func func,
+				 gpointer data)
+{
+	object_root = path;
+	return dbus_connection_register_fallback(dbus, path, &object_vtable,
+						 libdbus_handler_new(func,
+								     data));
+}
+
+gboolean libdbus_add_filter(lui_transport_func func, gpointer data)
+{
+	return dbus_connection_add_filter(dbus, on_filter_message,
+					  libdbus_handler_new(func, data),
+					  g_free);
+}
+
+gboolean libdbus_request_name(const char *name)
+{
+	return dbus_bus_request_name(dbus, name, 0, NULL) ==
+	    DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER;
+}
+
+/* No error argument, so these do not block */
+void libdbus_add_match(const char *rule)
+{
+	dbus_bus_add_match(dbus, rule, NULL);
+}
+
+void libdbus_remove_match(const char *rule)
+{
+	dbus_bus_remove_match(dbus, rule, NULL);
+}
+
+gboolean libdbus_send(lui_msg * msg)
+{
+	return dbus_connection_send(dbus, MSG(msg), NULL);
+}
+
+void libdbus_flush(void)
+{
+	dbus_connection_flush(dbus);
+}
@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdarg.h>
+
+#include "transport.h"
+
+/* macros */
+#define nelem(x) (sizeof (x) / sizeof *(x))
+
+#define INTROSPECTABLE "org.freedesktop.DBus.Introspectable"
+
+/*
+ * Introspection data is fixed, so it is kept as the finished documents.
+ * Optional trailing arguments are listed in their longest form.
+ */
+#define INTROSPECT_HEADER \
+	"<!DOCTYPE node PUBLIC " \
+	"\"-//freedesktop//DTD D-BUS Object Introspection 1.0//EN\"\n" \
+	"\"http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd\">\n" \
+	"<node>\n" \
+	" <interface name=\"" INTROSPECTABLE "\">\n" \
+	"  <method name=\"Introspect\">\n" \
+	"   <arg name=\"xml\" type=\"s\" direction=\"out\"/>\n" \
+	"  </method>\n" \
+	" </interface>\n"
+
+#define INTROSPECT_REQUEST(name, args) \
+	"  <method name=\"" name "\">\n" args \
+	"   <arg name=\"path\" type=\"o\" direction=\"out\"/>\n" \
+	"  </method>\n"
+
+#define INTROSPECT_PRIVACY(type) \
+	"   <arg name=\"accepted\" type=\"" type "\" direction=\"in\"/>\n" \
+	"   <arg name=\"strings\" type=\"as\" direction=\"in\"/>\n"
+
+static const char root_xml[] =
+	INTROSPECT_HEADER
+	" <interface name=\"com.nokia.Location.UI\">\n"
+	INTROSPECT_REQUEST("location_verification", INTROSPECT_PRIVACY("i"))
+	INTROSPECT_REQUEST("location_information", INTROSPECT_PRIVACY("i"))
+	INTROSPECT_REQUEST("location_timeout", INTROSPECT_PRIVACY("i"))
+	INTROSPECT_REQUEST("location_expired", INTROSPECT_PRIVACY("b"))
+	INTROSPECT_REQUEST("location_default_supl",
+			   "   <arg name=\"server\" type=\"s\""
+			   " direction=\"in\"/>\n")
+	"  <method name=\"display_batch\">\n"
+	"   <arg name=\"dialogs\" type=\"a(si)\" direction=\"in\"/>\n"
+	"   <arg name=\"results\" type=\"a(bi)\" direction=\"out\"/>\n"
+	"  </method>\n"
+	"  <method name=\"close_batch\">\n"
+	"   <arg name=\"dialogs\" type=\"as\" direction=\"in\"/>\n"
+	"   <arg name=\"codes\" type=\"ai\" direction=\"out\"/>\n"
+	"  </method>\n"
+	"  <method name=\"get_stats\">\n"
+	"   <arg name=\"counters\" type=\"a{st}\" direction=\"out\"/>\n"
+	"   <arg name=\"histograms\" type=\"a(sstttat)\" direction=\"out\"/>\n"
+	"  </method>\n"
+	"  <method name=\"dump_trace\">\n"
+	"   <arg name=\"path\" type=\"s\" direction=\"out\"/>\n"
+	"  </method>\n"
+	"  <method name=\"get_memory\">\n"
+	"   <arg name=\"bytes\" type=\"a{st}\" direction=\"out\"/>\n"
+	"  </method>\n"
+	" </interface>\n"
+	"</node>\n";
+
+static const char dialog_xml[] =
+	INTROSPECT_HEADER
+	" <interface name=\"com.nokia.Location.UI.Dialog\">\n"
+	"  <method name=\"display\">\n"
+	"   <arg name=\"arg\" type=\"i\" direction=\"in\"/>\n"
+	"   <arg name=\"priority\" type=\"i\" direction=\"in\"/>\n"
+	"   <arg name=\"deadline_ms\" type=\"u\" direction=\"in\"/>\n"
+	"  </method>\n"
+	"  <method name=\"close\">\n"
+	"   <arg name=\"response\" type=\"i\" direction=\"out\"/>\n"
+	"  </method>\n"
+	"  <method name=\"display_and_wait\">\n"
+	"   <arg name=\"arg\" type=\"i\" direction=\"in\"/>\n"
+	"   <arg name=\"timeout_ms\" type=\"u\" direction=\"in\"/>\n"
+	"   <arg name=\"priority\" type=\"i\" direction=\"in\"/>\n"
+	"   <arg name=\"deadline_ms\" type=\"u\" direction=\"in\"/>\n"
+	"   <arg name=\"response\" type=\"i\" direction=\"out\"/>\n"
+	"  </method>\n"
+	"  <signal name=\"response\">\n"
+	"   <arg name=\"code\" type=\"i\"/>\n"
+	"  </signal>\n"
+	" </interface>\n"
+	"</node>\n";
+
+static const lui_transport *transports[] = {
+#ifdef HAVE_LIBDBUS
+	&lui_transport_libdbus,
+#endif
+#ifdef HAVE_GDBUS
+	&lui_transport_gdbus,
+#endif
+};
+
+const lui_transport *lui_transport_current;
+
+const lui_transport *lui_transport_find(const char *name)
+{
+	int i;
+
+	for (i = 0; i < nelem(transports); i++)
+		if (!g_strcmp0(transports[i]->name, name))
+			return transports[i];
+
+	return NULL;
+}
+
+/* The reply to an Introspect call on an object below root, else NULL */
+lui_msg *lui_transport_introspect(lui_msg * msg, const char *root)
+{
+	const char *xml;
+	lui_msg *reply;
+
+	if (!lui_msg_is_method_call(msg, INTROSPECTABLE, "Introspect"))
+		return NULL;
+
+	xml = !g_strcmp0(lui_msg_get_path(msg), root) ? root_xml : dialog_xml;
+	reply = lui_msg_new_method_return(msg);
+	lui_msg_append_args(reply, LUI_TYPE_STRING, &xml, LUI_TYPE_INVALID);
+	return reply;
+}
+
+/*
+ * Basic arguments only, each type followed by where to store the value.
+ * Strings point into msg.
+ */
+gboolean lui_msg_get_args(lui_msg * msg, lui_msg_error * err,
+			  int first_type, ...)
+{
+	lui_msg_iter iter;
+	gboolean more;
+	va_list ap;
+	int type;
+
+	more = lui_msg_iter_init(msg, &iter);
+	va_start(ap, first_type);
+	for (type = first_type; type != LUI_TYPE_INVALID;
+	     type = va_arg(ap, int)) {
+		if (!more || lui_msg_iter_get_arg_type(&iter) != type) {
+			va_end(ap);
+			if (err)
+				lui_msg_set_error(err,
+						  LUI_BUS_ERROR_INVALID_ARGS,
+						  "Argument of type %c missing",
+						  type);
+			return FALSE;
+		}
+
+		lui_msg_iter_get_basic(&iter, va_arg(ap, void *));
+		more = lui_msg_iter_next(&iter);
+	}
+	va_end(ap);
+
+	return TRUE;
+}
+
+/*
+ * Each type is followed by a pointer to the value; LUI_TYPE_ARRAY by the
+ * element type, a pointer to the first element's pointer and the count.
+ */
+void lui_msg_append_args(lui_msg * msg, int first_type, ...)
+{
+	lui_msg_iter iter, array;
+	char signature[2] = { 0 };
+	const void *elements;
+	va_list ap;
+	int type, n;
+
+	lui_msg_iter_init_append(msg, &iter);
+	va_start(ap, first_type);
+	for (type = first_type; type != LUI_TYPE_INVALID;
+	     type = va_arg(ap, int)) {
+		if (type != LUI_TYPE_ARRAY) {
+			lui_msg_iter_append_basic(&iter, type,
+						  va_arg(ap, const void *));
+			continue;
+		}
+
+		signature[0] = va_arg(ap, int);
+		elements = va_arg(ap, const void *);
+		n = va_arg(ap, int);
+		lui_msg_iter_open_container(&iter, LUI_TYPE_ARRAY, signature,
+					    &array);
+		lui_msg_iter_append_fixed_array(&array, signature[0],
+						elements, n);
+		lui_msg_iter_close_container(&iter, &array);
+	}
+	va_end(ap);
+}
+
+lui_msg *lui_msg_new_error_printf(lui_msg * call, const char *name,
+				  const char *format, ...)
+{
+	lui_msg *reply;
+	char *message;
+	va_list ap;
+
+	va_start(ap, format);
+	message = g_strdup_vprintf(format, ap);
+	va_end(ap);
+
+	reply = lui_msg_new_error(call, name, message);
+	g_free(message);
+	return reply;
+}
+
+void lui_msg_set_error(lui_msg_error * err, const char *name,
+		       const char *format, ...)
+{
+	va_list ap;
+
+	g_return_if_fail(!lui_msg_error_is_set(err));
+
+	va_start(ap, format);
+	err->message = g_strdup_vprintf(format, ap);
+	va_end(ap);
+	err->name = name;
+}
+
+void lui_msg_error_free(lui_msg_error * err)
+{
+	g_free(err->message);
+	lui_msg_error_init(err);
+}
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef __LOCATION_UI_TRANSPORT_H__
+#define __LOCATION_UI_TRANSPORT_H__
+
+#include <glib.h>
+
+/*
+ * A bus message as the dialog core sees it. Each backend keeps its own
+ * library's messages behind it, the libdbus one without any wrapper.
+ */
+typedef struct lui_msg lui_msg;
+
+/* Reads or appends arguments in order, like a DBusMessageIter */
+typedef struct lui_msg_iter {
+	gpointer priv[16];
+} lui_msg_iter;
+
+/* Argument types carry their D-Bus signature codes */
+#define LUI_TYPE_INVALID	'\0'
+#define LUI_TYPE_BYTE		'y'
+#define LUI_TYPE_BOOLEAN	'b'	/* as a gboolean */
+#define LUI_TYPE_INT32		'i'
+#define LUI_TYPE_UINT32		'u'
+#define LUI_TYPE_INT64		'x'
+#define LUI_TYPE_UINT64		't'
+#define LUI_TYPE_DOUBLE		'd'
+#define LUI_TYPE_STRING		's'
+#define LUI_TYPE_OBJECT_PATH	'o'
+#define LUI_TYPE_ARRAY		'a'
+#define LUI_TYPE_STRUCT		'r'
+#define LUI_TYPE_DICT_ENTRY	'e'
+
+#define LUI_BUS_NAME		"org.freedesktop.DBus"
+#define LUI_BUS_PATH		"/org/freedesktop/DBus"
+#define LUI_BUS_INTERFACE	LUI_BUS_NAME
+#define LUI_BUS_ERROR_FAILED	LUI_BUS_NAME".Error.Failed"
+#define LUI_BUS_ERROR_INVALID_ARGS LUI_BUS_NAME".Error.InvalidArgs"
+#define LUI_BUS_ERROR_LIMITS_EXCEEDED LUI_BUS_NAME".Error.LimitsExceeded"
+#define LUI_BUS_ERROR_UNKNOWN_METHOD LUI_BUS_NAME".Error.UnknownMethod"
+
+typedef enum {
+	LUI_MSG_NOT_HANDLED,
+	LUI_MSG_HANDLED,
+} lui_msg_result;
+
+/* Why a message was refused, name is NULL while unset */
+typedef struct lui_msg_error {
+	const char *name;
+	char *message;
+} lui_msg_error;
+
+/* Handles one incoming message in the core's context */
+typedef lui_msg_result (*lui_transport_func)(lui_msg *, gpointer);
+
+/*
+ * What the core does with a message, in the backend's own library. The
+ * strings a message returns and the ones read from its arguments stay
+ * valid for as long as the message is referenced.
+ */
+typedef struct lui_msg_ops {
+	lui_msg *(*ref)(lui_msg *);
+	void (*unref)(lui_msg *);
+	const char *(*path)(lui_msg *);
+	const char *(*member)(lui_msg *);
+	const char *(*sender)(lui_msg *);
+	gboolean (*is_method_call)(lui_msg *, const char *, const char *);
+	gboolean (*is_signal)(lui_msg *, const char *, const char *);
+	lui_msg *(*new_method_return)(lui_msg *);
+	lui_msg *(*new_error)(lui_msg *, const char *, const char *);
+	lui_msg *(*new_signal)(const char *, const char *, const char *);
+	void (*set_destination)(lui_msg *, const char *);
+
+	/* Reading, an iterator past the last argument is LUI_TYPE_INVALID */
+	gboolean (*iter_init)(lui_msg *, lui_msg_iter *);
+	int (*arg_type)(lui_msg_iter *);
+	int (*element_type)(lui_msg_iter *);
+	gboolean (*next)(lui_msg_iter *);
+	void (*get_basic)(lui_msg_iter *, void *);
+	void (*recurse)(lui_msg_iter *, lui_msg_iter *);
+
+	/* Appending, signatures must outlive the containers they open */
+	void (*init_append)(lui_msg *, lui_msg_iter *);
+	void (*append_basic)(lui_msg_iter *, int, const void *);
+	void (*append_fixed_array)(lui_msg_iter *, int, const void *, int);
+	void (*open_container)(lui_msg_iter *, int, const char *,
+			       lui_msg_iter *);
+	void (*close_container)(lui_msg_iter *, lui_msg_iter *);
+} lui_msg_ops;
+
+/*
+ * The connection to the system bus. A backend moves messages between the
+ * bus and the main context given to connect(), where the handlers run
+ * one at a time. Method calls a handler leaves NOT_HANDLED are answered
+ * with UnknownMethod, Introspect is answered by the backend.
+ */
+typedef struct lui_transport {
+	const char *name;
+	const lui_msg_ops *msg;
+	gboolean (*connect)(GMainContext *);
+	/* Method calls on path and every path below it */
+	gboolean (*register_object)(const char *path, lui_transport_func,
+				    gpointer);
+	/* Signals delivered through match rules */
+	gboolean (*add_filter)(lui_transport_func, gpointer);
+	gboolean (*request_name)(const char *);
+	void (*add_match)(const char *);	/* neither waits for the bus */
+	void (*remove_match)(const char *);
+	/* Queued without waiting for the socket, msg stays the caller's */
+	gboolean (*send)(lui_msg *);
+	void (*flush)(void);	/* blocks until all is written */
+} lui_transport;
+
+#ifdef HAVE_LIBDBUS
+extern const lui_transport lui_transport_libdbus;
+#endif
+#ifdef HAVE_GDBUS
+extern const lui_transport lui_transport_gdbus;
+#endif
+
+/* The backend whose messages lui_msg_* work on, one per process */
+extern const lui_transport *lui_transport_current;
+
+const lui_transport *lui_transport_find(const char *);
+lui_msg *lui_transport_introspect(lui_msg *, const char *);
+
+gboolean lui_msg_get_args(lui_msg *, lui_msg_error *, int, ...);
+void lui_msg_append_args(lui_msg *, int, ...);
+lui_msg *lui_msg_new_error_printf(lui_msg *, const char *, const char *,
+				  ...) G_GNUC_PRINTF(3, 4);
+void lui_msg_set_error(lui_msg_error *, const char *, const char *, ...)
+    G_GNUC_PRINTF(3, 4);
+void lui_msg_error_free(lui_msg_error *);
+
+#define lui_msg_error_init(e)	((e)->name = NULL, (e)->message = NULL)
+#define lui_msg_error_is_set(e)	((e)->name != NULL)
+
+#define LUI_MSG_OPS (lui_transport_current->msg)
+
+static inline lui_msg *lui_msg_ref(lui_msg *msg)
+{
+	return LUI_MSG_OPS->ref(msg);
+}
+
+static inline void lui_msg_unref(lui_msg *msg)
+{
+	LUI_MSG_OPS->unref(msg);
+}
+
+static inline const char *lui_msg_get_path(lui_msg *msg)
+{
+	return LUI_MSG_OPS->path(msg);
+}
+
+static inline const char *lui_msg_get_member(lui_msg *msg)
+{
+	return LUI_MSG_OPS->member(msg);
+}
+
+static inline const char *lui_msg_get_sender(lui_msg *msg)
+{
+	return LUI_MSG_OPS->sender(msg);
+}
+
+static inline gboolean lui_msg_is_method_call(lui_msg *msg,
+					      const char *interface,
+					      const char *member)
+{
+	return LUI_MSG_OPS->is_method_call(msg, interface, member);
+}
+
+static inline gboolean lui_msg_is_signal(lui_msg *msg, const char *interface,
+					 const char *member)
+{
+	return LUI_MSG_OPS->is_signal(msg, interface, member);
+}
+
+static inline lui_msg *lui_msg_new_method_return(lui_msg *call)
+{
+	return LUI_MSG_OPS->new_method_return(call);
+}
+
+static inline lui_msg *lui_msg_new_error(lui_msg *call, const char *name,
+					 const char *message)
+{
+	return LUI_MSG_OPS->new_error(call, name, message);
+}
+
+static inline lui_msg *lui_msg_new_signal(const char *path,
+					  const char *interface,
+					  const char *member)
+{
+	return LUI_MSG_OPS->new_signal(path, interface, member);
+}
+
+static inline void lui_msg_set_destination(lui_msg *msg, const char *name)
+{
+	LUI_MSG_OPS->set_destination(msg, name);
+}
+
+static inline gboolean lui_msg_iter_init(lui_msg *msg, lui_msg_iter *iter)
+{
+	return LUI_MSG_OPS->iter_init(msg, iter);
+}
+
+static inline int lui_msg_iter_get_arg_type(lui_msg_iter *iter)
+{
+	return LUI_MSG_OPS->arg_type(iter);
+}
+
+static inline int lui_msg_iter_get_element_type(lui_msg_iter *iter)
+{
+	return LUI_MSG_OPS->element_type(iter);
+}
+
+static inline gboolean lui_msg_iter_next(lui_msg_iter *iter)
+{
+	return LUI_MSG_OPS->next(iter);
+}
+
+static inline void lui_msg_iter_get_basic(lui_msg_iter *iter, void *value)
+{
+	LUI_MSG_OPS->get_basic(iter, value);
+}
+
+static inline void lui_msg_iter_recurse(lui_msg_iter *iter,
+					lui_msg_iter *sub)
+{
+	LUI_MSG_OPS->recurse(iter, sub);
+}
+
+static inline void lui_msg_iter_init_append(lui_msg *msg, lui_msg_iter *iter)
+{
+	LUI_MSG_OPS->init_append(msg, iter);
+}
+
+static inline void lui_msg_iter_append_basic(lui_msg_iter *iter, int type,
+					     const void *value)
+{
+	LUI_MSG_OPS->append_basic(iter, type, value);
+}
+
+/* value points to the pointer to the first element, as with libdbus */
+static inline void lui_msg_iter_append_fixed_array(lui_msg_iter *iter,
+						   int type,
+						   const void *value, int n)
+{
+	LUI_MSG_OPS->append_fixed_array(iter, type, value, n);
+}
+
+static inline void lui_msg_iter_open_container(lui_msg_iter *iter, int type,
+					       const char *signature,
+					       lui_msg_iter *sub)
+{
+	LUI_MSG_OPS->open_container(iter, type, signature, sub);
+}
+
+static inline void lui_msg_iter_close_container(lui_msg_iter *iter,
+						lui_msg_iter *sub)
+{
+	LUI_MSG_OPS->close_container(iter, sub);
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2021 Ivan J. <parazyd@dyne.org>
+ *
+ * This file is part of location-ui
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ * Decoder for trace rings dumped by location-ui, either on SIGUSR1 or
+ * through its dump_trace method. Prints one event per line.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "trace.h"
+
+static void print_event(const lui_trace_header * header,
+			const lui_trace_event * e, gint64 first)
+{
+	gint64 wall = header->realtime - (header->monotonic - e->time);
+	time_t secs = wall / G_USEC_PER_SEC;
+	char stamp[32];
+
+	strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&secs));
+	printf("%s.%06ld %+12.3f ms  %-9s %-22s %8u %6d\n", stamp,
+	       (long)(wall % G_USEC_PER_SEC), (e->time - first) / 1000.0,
+	       lui_trace_type_name(e->type), lui_trace_kind_name(e->kind),
+	       e->id, e->arg);
+}
+
+int main(int argc, char **argv)
+{
+	lui_trace_header header;
+	lui_trace_event e;
+	gint64 first = 0;
+	guint32 i;
+	FILE *f;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s TRACE-FILE\n", argv[0]);
+		return 1;
+	}
+
+	if (!(f = fopen(argv[1], "rb"))) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    memcmp(header.magic, LUI_TRACE_MAGIC, sizeof(header.magic))) {
+		fprintf(stderr, "%s: not a location-ui trace\n", argv[1]);
+		return 1;
+	}
+
+	if (header.version != LUI_TRACE_VERSION ||
+	    header.event_size != sizeof(lui_trace_event)) {
+		fprintf(stderr, "%s: unsupported trace version %u\n", argv[1],
+			header.version);
+		return 1;
+	}
+
+	printf("# %u events, %u older ones dropped\n", header.count,
+	       header.dropped);
+	printf("# %-22s %15s  %-9s %-22s %8s %6s\n", "time", "since first",
+	       "event", "dialog", "id", "arg");
+
+	for (i = 0; i < header.count; i++) {
+		if (fread(&e, sizeof(e), 1, f) != 1) {
+			fprintf(stderr, "%s: truncated after %u events\n",
+				argv[1], i);
+			return 1;
+		}
+
+		if (!i)
+			first = e.time;
+		print_event(&header, &e, first);
+	}
+
+	fclose(f);
+	return 0;
+}